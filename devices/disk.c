@@ -85,6 +85,7 @@ static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
 static void select_sector (struct disk *, disk_sector_t);
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -226,6 +227,89 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 	lock_release (&c->lock);
 }
 
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Issues one command per 256 sectors instead of one per
+   sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer_,
+		size_t cnt) {
+	uint8_t *buffer = buffer_;
+	struct channel *c;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	c = d->channel;
+	while (cnt > 0) {
+		size_t batch = cnt < 256 ? cnt : 256;
+		size_t i;
+
+		lock_acquire (&c->lock);
+		select_sectors (d, sec_no, batch);
+		issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+
+		/* The drive interrupts once per sector it has ready. */
+		for (i = 0; i < batch; i++) {
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+						sec_no + (disk_sector_t) i);
+			input_sector (c, buffer + i * DISK_SECTOR_SIZE);
+			d->read_cnt++;
+		}
+		lock_release (&c->lock);
+
+		sec_no += batch;
+		buffer += batch * DISK_SECTOR_SIZE;
+		cnt -= batch;
+	}
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Issues one command per 256 sectors instead of one per sector.
+   Returns after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *buffer_, size_t cnt) {
+	const uint8_t *buffer = buffer_;
+	struct channel *c;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	c = d->channel;
+	while (cnt > 0) {
+		size_t batch = cnt < 256 ? cnt : 256;
+		size_t i;
+
+		lock_acquire (&c->lock);
+		select_sectors (d, sec_no, batch);
+		issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+
+		/* The drive takes one sector at a time and interrupts once
+		   it has written each. */
+		for (i = 0; i < batch; i++) {
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+						sec_no + (disk_sector_t) i);
+			output_sector (c, buffer + i * DISK_SECTOR_SIZE);
+			sema_down (&c->completion_wait);
+			d->write_cnt++;
+		}
+		lock_release (&c->lock);
+
+		sec_no += batch;
+		buffer += batch * DISK_SECTOR_SIZE;
+		cnt -= batch;
+	}
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    DISK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
@@ -406,13 +490,21 @@ print_ata_string (char *string, size_t size) {
    use LBA mode.) */
 static void
 select_sector (struct disk *d, disk_sector_t sec_no) {
+	select_sectors (d, sec_no, 1);
+}
+
+/* Like select_sector(), but selects CNT sectors, between 1 and
+   256, starting at SEC_NO. */
+static void
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt >= 1 && cnt <= 256);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == 256 ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
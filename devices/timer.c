@@ -7,6 +7,9 @@
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/vdata.h"
+#endif
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -129,6 +132,9 @@ timer_interrupt(struct intr_frame *args UNUSED)
 	ticks++;
 	thread_tick();
 	thread_awake(ticks); // ticks 가 증가할때마다 awake 작업 수행
+#ifdef USERPROG
+	vdata_tick(ticks);
+#endif
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
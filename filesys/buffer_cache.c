@@ -0,0 +1,533 @@
+/* buffer_cache.c: Sector cache in front of the file system disks.
+ * Every mounted file system has a partition of its own, so that one
+ * busy mount cannot evict the sectors of another. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "filesys/mount.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A cached disk sector. */
+struct cache_entry {
+	/* Protected by the partition's lock. */
+	disk_sector_t sector;               /* Cached sector, if IN_USE. */
+	bool in_use;                        /* Holds a sector? */
+	bool accessed;                      /* Reference bit for the clock. */
+	int pin_cnt;                        /* Threads using this entry. */
+
+	/* Protected by LOCK. */
+	struct lock lock;                   /* Serializes access to DATA. */
+	bool dirty;                         /* DATA differs from the disk? */
+	uint64_t txn;                       /* Journal transaction that must
+	                                       commit before DATA is written
+	                                       home, or 0. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+};
+
+/* The cache of one mounted file system.  Entries hold sectors of
+ * that mount only. */
+struct cache_part {
+	struct disk *disk;                  /* Disk of the mount. */
+	struct cache_entry entries[BUFFER_CACHE_SIZE];
+
+	/* Protects the sector mapping, pin counts and the clock hand.
+	 * Never acquired while holding an entry's lock. */
+	struct lock lock;
+
+	/* Signaled when an entry's pin count drops to zero, and
+	 * broadcast when a journal commit ends. */
+	struct condition unpinned;
+
+	/* Next entry examined by the clock replacement. */
+	size_t clock_hand;
+
+	/* Statistics, protected by LOCK. */
+	long long hit_cnt;                  /* Lookups served from the cache. */
+	long long miss_cnt;                 /* Lookups that needed an entry. */
+	long long read_cnt;                 /* Sectors read from disk. */
+	long long write_cnt;                /* Sectors written to disk. */
+	long long readahead_read_cnt;       /* Sectors prefetched from disk. */
+};
+
+/* Partitions, indexed by mount index, or null for mounts without
+ * one.  The root file system's partition is never freed. */
+static struct cache_part root_part;
+static struct cache_part *parts[MOUNT_MAX];
+
+/* Sectors queued for asynchronous readahead, consumed by the
+ * readahead daemon.  A full queue drops new requests. */
+#define READAHEAD_QUEUE_SIZE 64
+static disk_sector_t readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head, readahead_cnt;
+static struct lock readahead_lock;      /* Protects the queue. */
+static struct semaphore readahead_sema; /* Up'd once per queued sector. */
+
+/* Held by the readahead daemon while it loads a sector, so that the
+ * partition it loads into is not detached under it. */
+static struct lock readahead_run_lock;
+
+static void readahead_daemon (void *aux);
+
+/* Initializes partition P for the sectors of DISK. */
+static void
+part_init (struct cache_part *p, struct disk *disk) {
+	size_t i;
+
+	p->disk = disk;
+	lock_init (&p->lock);
+	cond_init (&p->unpinned);
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &p->entries[i];
+		e->in_use = false;
+		e->accessed = false;
+		e->pin_cnt = 0;
+		e->dirty = false;
+		e->txn = 0;
+		lock_init (&e->lock);
+	}
+	p->clock_hand = 0;
+	p->hit_cnt = p->miss_cnt = 0;
+	p->read_cnt = p->write_cnt = p->readahead_read_cnt = 0;
+}
+
+/* Adds one to the statistics counter CNT of P. */
+static void
+part_count (struct cache_part *p, long long *cnt) {
+	lock_acquire (&p->lock);
+	(*cnt)++;
+	lock_release (&p->lock);
+}
+
+/* Returns the partition that caches SECTOR. */
+static struct cache_part *
+part_of (disk_sector_t sector) {
+	struct cache_part *p = parts[mount_id (sector)];
+
+	ASSERT (p != NULL);
+	return p;
+}
+
+/* Initializes the buffer cache, with a partition for the root file
+ * system. */
+void
+buffer_cache_init (void) {
+	part_init (&root_part, filesys_disk);
+	parts[0] = &root_part;
+
+	lock_init (&readahead_lock);
+	lock_init (&readahead_run_lock);
+	sema_init (&readahead_sema, 0);
+	readahead_head = readahead_cnt = 0;
+	if (thread_create ("readahead", PRI_DEFAULT, readahead_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("readahead daemon creation failed");
+}
+
+/* Adds a partition for mount ID, whose file system is on DISK.
+ * Returns false if memory allocation fails. */
+bool
+buffer_cache_attach (int id, struct disk *disk) {
+	struct cache_part *p;
+
+	ASSERT (id > 0 && id < MOUNT_MAX);
+	ASSERT (parts[id] == NULL);
+
+	p = malloc (sizeof *p);
+	if (p == NULL)
+		return false;
+	part_init (p, disk);
+	parts[id] = p;
+	return true;
+}
+
+/* Writes back and drops the partition of mount ID.  Nothing may
+ * access the mount's sectors any more. */
+void
+buffer_cache_detach (int id) {
+	struct cache_part *p;
+	size_t i, n;
+
+	ASSERT (id > 0 && id < MOUNT_MAX);
+
+	/* Drop queued readahead of the mount and wait out the one being
+	 * loaded, if any. */
+	lock_acquire (&readahead_run_lock);
+	lock_acquire (&readahead_lock);
+	for (i = n = 0; i < readahead_cnt; i++) {
+		disk_sector_t sector = readahead_queue[(readahead_head + i)
+			% READAHEAD_QUEUE_SIZE];
+		if (mount_id (sector) != id)
+			readahead_queue[(readahead_head + n++) % READAHEAD_QUEUE_SIZE]
+				= sector;
+	}
+	readahead_cnt = n;
+	lock_release (&readahead_lock);
+
+	p = parts[id];
+	parts[id] = NULL;
+	lock_release (&readahead_run_lock);
+
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &p->entries[i];
+
+		ASSERT (e->pin_cnt == 0);
+		if (e->in_use && e->dirty) {
+			disk_write (p->disk, mount_disk_sector (e->sector), e->data);
+			p->write_cnt++;
+		}
+	}
+	free (p);
+}
+
+/* Returns the entry of P caching SECTOR, or a null pointer.
+ * Must be called with P's lock held. */
+static struct cache_entry *
+cache_lookup (struct cache_part *p, disk_sector_t sector) {
+	size_t i;
+
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+		if (p->entries[i].in_use && p->entries[i].sector == sector)
+			return &p->entries[i];
+	return NULL;
+}
+
+/* Chooses an unpinned, clean entry of P with the clock algorithm
+ * and returns it.  Returns a null pointer instead if P's lock had to
+ * be dropped, to wait for an entry to be unpinned or committed or to
+ * write a dirty victim back, in which case the caller must look its
+ * sector up again before retrying.
+ * Must be called with P's lock held. */
+static struct cache_entry *
+cache_evict (struct cache_part *p) {
+	bool uncommitted = false;
+	bool written = false;
+	size_t i;
+
+	/* Two sweeps clear every reference bit at least once. */
+	for (i = 0; i < 2 * BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &p->entries[p->clock_hand];
+		p->clock_hand = (p->clock_hand + 1) % BUFFER_CACHE_SIZE;
+
+		if (e->pin_cnt > 0)
+			continue;
+		if (!journal_committed (e->txn)) {
+			uncommitted = true;
+			continue;
+		}
+		if (e->in_use && e->accessed) {
+			e->accessed = false;
+			continue;
+		}
+
+		if (e->in_use && e->dirty) {
+			/* Pin the victim so that it stays put, and write it back
+			 * without holding P's lock.  A lookup meanwhile finds it
+			 * and waits on its lock; the caller's next sweep evicts
+			 * it if it is still clean and unreferenced by then. */
+			e->pin_cnt++;
+			lock_release (&p->lock);
+
+			lock_acquire (&e->lock);
+			if (e->dirty && journal_committed (e->txn)) {
+				disk_write (p->disk, mount_disk_sector (e->sector), e->data);
+				e->dirty = false;
+				written = true;
+			}
+			lock_release (&e->lock);
+
+			lock_acquire (&p->lock);
+			if (written)
+				p->write_cnt++;
+			if (--e->pin_cnt == 0)
+				cond_signal (&p->unpinned, &p->lock);
+			return NULL;
+		}
+
+		/* Nobody holds E's lock: only pinned entries are locked. */
+		e->in_use = false;
+		e->dirty = false;
+		e->txn = 0;
+		return e;
+	}
+
+	/* Every idle entry waits for its transaction to commit.  The
+	 * caller may be inside an operation, which the commit would
+	 * wait for, so have the journal daemon commit instead.  The
+	 * running transaction never fills the cache, so an operation
+	 * that waits here finds a victim once the others unpin theirs. */
+	if (uncommitted)
+		journal_request_commit ();
+	cond_wait (&p->unpinned, &p->lock);
+	return NULL;
+}
+
+/* Returns the locked and pinned entry for SECTOR, loading it from
+ * disk unless LOAD is false, in which case the caller is about to
+ * overwrite the whole sector. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool load) {
+	struct cache_part *p = part_of (sector);
+	struct cache_entry *e;
+
+	lock_acquire (&p->lock);
+	for (;;) {
+		e = cache_lookup (p, sector);
+		if (e != NULL) {
+			p->hit_cnt++;
+			e->pin_cnt++;
+			e->accessed = true;
+			lock_release (&p->lock);
+			lock_acquire (&e->lock);
+			return e;
+		}
+		e = cache_evict (p);
+		if (e != NULL)
+			break;
+	}
+
+	p->miss_cnt++;
+	if (load)
+		p->read_cnt++;
+	e->sector = sector;
+	e->in_use = true;
+	e->accessed = true;
+	e->pin_cnt = 1;
+
+	/* Lock the entry before publishing it, so that a concurrent
+	 * lookup of SECTOR waits for the load below. */
+	lock_acquire (&e->lock);
+	lock_release (&p->lock);
+
+	if (load)
+		disk_read (p->disk, mount_disk_sector (sector), e->data);
+	return e;
+}
+
+/* Unlocks and unpins E. */
+static void
+cache_put (struct cache_entry *e) {
+	struct cache_part *p = part_of (e->sector);
+
+	lock_release (&e->lock);
+
+	lock_acquire (&p->lock);
+	if (--e->pin_cnt == 0)
+		cond_signal (&p->unpinned, &p->lock);
+	lock_release (&p->lock);
+}
+
+/* Reads SIZE bytes starting at SECTOR_OFS within SECTOR into
+ * BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int sector_ofs,
+		int size) {
+	struct cache_entry *e;
+
+	ASSERT (sector_ofs >= 0 && size >= 0);
+	ASSERT (sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true);
+	memcpy (buffer, e->data + sector_ofs, size);
+	cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at
+ * SECTOR_OFS.  The sector reaches the disk when it is evicted or
+ * flushed. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer,
+		int sector_ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (sector_ofs >= 0 && size >= 0);
+	ASSERT (sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size != DISK_SECTOR_SIZE);
+	memcpy (e->data + sector_ofs, buffer, size);
+	e->dirty = true;
+	cache_put (e);
+}
+
+/* Like buffer_cache_write(), but for file system metadata, which
+ * is logged in the journal as part of the caller's operation and
+ * only written home once the transaction commits.  Only the root
+ * file system has a journal; metadata of other mounts is written
+ * like data. */
+void
+buffer_cache_write_meta (disk_sector_t sector, const void *buffer,
+		int sector_ofs, int size) {
+	struct cache_entry *e;
+	uint64_t txn;
+
+	ASSERT (sector_ofs >= 0 && size >= 0);
+	ASSERT (sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	if (mount_id (sector) != 0) {
+		buffer_cache_write (sector, buffer, sector_ofs, size);
+		return;
+	}
+
+	journal_begin ();
+	e = cache_get (sector, size != DISK_SECTOR_SIZE);
+	memcpy (e->data + sector_ofs, buffer, size);
+	e->dirty = true;
+	txn = journal_log (sector, e->data);
+	if (txn != 0)
+		e->txn = txn;
+	cache_put (e);
+	journal_end ();
+}
+
+/* Writes every dirty sector of P back to disk, except metadata
+ * whose journal transaction has not committed yet. */
+static void
+part_flush (struct cache_part *p) {
+	size_t i;
+
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &p->entries[i];
+		bool written;
+
+		lock_acquire (&p->lock);
+		if (!e->in_use) {
+			lock_release (&p->lock);
+			continue;
+		}
+		e->pin_cnt++;
+		lock_release (&p->lock);
+
+		lock_acquire (&e->lock);
+		written = e->dirty && journal_committed (e->txn);
+		if (written) {
+			disk_write (p->disk, mount_disk_sector (e->sector), e->data);
+			e->dirty = false;
+		}
+		cache_put (e);
+		if (written)
+			part_count (p, &p->write_cnt);
+	}
+}
+
+/* Writes every dirty sector of every mount back to disk, except
+ * metadata whose journal transaction has not committed yet. */
+void
+buffer_cache_flush (void) {
+	int id;
+
+	for (id = 0; id < MOUNT_MAX; id++)
+		if (parts[id] != NULL)
+			part_flush (parts[id]);
+}
+
+/* Wakes threads waiting for an entry to evict, after a journal
+ * commit made the entries of its transaction evictable. */
+void
+buffer_cache_committed (void) {
+	int id;
+
+	for (id = 0; id < MOUNT_MAX; id++) {
+		struct cache_part *p = parts[id];
+
+		if (p != NULL) {
+			lock_acquire (&p->lock);
+			cond_broadcast (&p->unpinned, &p->lock);
+			lock_release (&p->lock);
+		}
+	}
+}
+
+/* Asks the readahead daemon to bring SECTOR into the cache.
+ * Returns without waiting for the disk. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	bool queued = false;
+
+	lock_acquire (&readahead_lock);
+	if (readahead_cnt < READAHEAD_QUEUE_SIZE) {
+		readahead_queue[(readahead_head + readahead_cnt++)
+			% READAHEAD_QUEUE_SIZE] = sector;
+		queued = true;
+	}
+	lock_release (&readahead_lock);
+
+	if (queued)
+		sema_up (&readahead_sema);
+}
+
+/* Loads queued readahead sectors that are not cached yet. */
+static void
+readahead_daemon (void *aux UNUSED) {
+	for (;;) {
+		disk_sector_t sector;
+		struct cache_part *p;
+		struct cache_entry *e;
+		bool cached;
+
+		sema_down (&readahead_sema);
+		lock_acquire (&readahead_run_lock);
+		lock_acquire (&readahead_lock);
+		if (readahead_cnt == 0) {
+			/* The request was dropped by buffer_cache_detach(). */
+			lock_release (&readahead_lock);
+			lock_release (&readahead_run_lock);
+			continue;
+		}
+		sector = readahead_queue[readahead_head];
+		readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+		readahead_cnt--;
+		lock_release (&readahead_lock);
+
+		p = part_of (sector);
+		lock_acquire (&p->lock);
+		cached = cache_lookup (p, sector) != NULL;
+		lock_release (&p->lock);
+		if (!cached) {
+			/* A reader that wants SECTOR meanwhile finds the entry
+			 * locked and waits for this load instead of issuing its
+			 * own. */
+			e = cache_get (sector, true);
+			cache_put (e);
+			part_count (p, &p->readahead_read_cnt);
+		}
+		lock_release (&readahead_run_lock);
+	}
+}
+
+/* Prints the statistics of P, labeled with LABEL. */
+static void
+part_print_stats (const char *label, struct cache_part *p) {
+	long long hit_cnt, miss_cnt, read_cnt, readahead_read_cnt, write_cnt;
+
+	lock_acquire (&p->lock);
+	hit_cnt = p->hit_cnt;
+	miss_cnt = p->miss_cnt;
+	read_cnt = p->read_cnt;
+	readahead_read_cnt = p->readahead_read_cnt;
+	write_cnt = p->write_cnt;
+	lock_release (&p->lock);
+
+	printf ("%s: %lld hits, %lld misses, "
+			"%lld disk reads (%lld readahead), %lld disk writes\n",
+			label, hit_cnt, miss_cnt, read_cnt, readahead_read_cnt, write_cnt);
+}
+
+/* Prints buffer cache statistics, for each mount. */
+void
+buffer_cache_print_stats (void) {
+	int id;
+
+	part_print_stats ("Buffer cache", &root_part);
+	for (id = 1; id < MOUNT_MAX; id++)
+		if (parts[id] != NULL) {
+			char label[32];
+
+			snprintf (label, sizeof label, "Buffer cache (mount %d)", id);
+			part_print_stats (label, parts[id]);
+		}
+}
@@ -0,0 +1,220 @@
+/* dcache.c: Cache of directory lookups, keyed by the directory's
+ * inode sector and the name looked up in it. */
+
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/mount.h"
+#include "threads/synch.h"
+
+/* A cached lookup. */
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in dcache_table. */
+	struct list_elem lru_elem;          /* Element in dcache_lru. */
+	disk_sector_t dir;                  /* Directory inode sector. */
+	char name[NAME_MAX + 1];            /* Name looked up in DIR. */
+	bool positive;                      /* Does NAME exist? */
+	disk_sector_t sector;               /* Its inode sector, if POSITIVE. */
+};
+
+/* Every dentry lives in this fixed pool, either on the LRU list
+ * or on the free list. */
+static struct dentry dentries[DCACHE_SIZE];
+
+/* Cached dentries.  DCACHE_LRU is ordered from most to least
+ * recently used.  Both, and DCACHE_FREE, are protected by
+ * dcache_lock. */
+static struct hash dcache_table;
+static struct list dcache_lru;
+static struct list dcache_free;
+static struct lock dcache_lock;
+
+/* Statistics. */
+static long long hit_cnt;               /* Positive or negative hits. */
+static long long miss_cnt;              /* Lookups not cached. */
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void) {
+	size_t i;
+
+	if (!hash_init (&dcache_table, dentry_hash, dentry_less, NULL))
+		PANIC ("dentry cache creation failed");
+	list_init (&dcache_lru);
+	list_init (&dcache_free);
+	lock_init (&dcache_lock);
+	for (i = 0; i < DCACHE_SIZE; i++)
+		list_push_back (&dcache_free, &dentries[i].lru_elem);
+}
+
+/* Returns the dentry for NAME in DIR, or a null pointer.
+ * Must be called with dcache_lock held. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache_table, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops D from the cache.
+ * Must be called with dcache_lock held. */
+static void
+dentry_drop (struct dentry *d) {
+	hash_delete (&dcache_table, &d->hash_elem);
+	list_remove (&d->lru_elem);
+	list_push_back (&dcache_free, &d->lru_elem);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+ * On a positive hit, stores the inode sector of NAME into
+ * *SECTORP. */
+enum dcache_result
+dcache_lookup (disk_sector_t dir, const char *name, disk_sector_t *sectorp) {
+	enum dcache_result result = DCACHE_MISS;
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return DCACHE_MISS;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&dcache_lru, &d->lru_elem);
+		if (d->positive) {
+			*sectorp = d->sector;
+			result = DCACHE_POSITIVE;
+		} else
+			result = DCACHE_NEGATIVE;
+		hit_cnt++;
+	} else
+		miss_cnt++;
+	lock_release (&dcache_lock);
+	return result;
+}
+
+/* Records the result of looking up NAME in DIR, evicting the least
+ * recently used dentry if the cache is full. */
+static void
+dentry_insert (disk_sector_t dir, const char *name, bool positive,
+		disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d == NULL) {
+		if (list_empty (&dcache_free))
+			dentry_drop (list_entry (list_back (&dcache_lru), struct dentry,
+						lru_elem));
+		d = list_entry (list_pop_front (&dcache_free), struct dentry,
+				lru_elem);
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dcache_table, &d->hash_elem);
+	} else
+		list_remove (&d->lru_elem);
+	list_push_front (&dcache_lru, &d->lru_elem);
+	d->positive = positive;
+	d->sector = sector;
+	lock_release (&dcache_lock);
+}
+
+/* Records that NAME in DIR has its inode in SECTOR.
+ *
+ * The caller must hold DIR's directory lock, and must have looked
+ * NAME up under it.  That orders the fill against dir_add() and
+ * dir_remove(), which change entries and the dentry under the same
+ * lock; otherwise a lookup that read the directory before a
+ * dir_add() could cache a stale negative dentry after it, hiding the
+ * new name until the dentry was evicted. */
+void
+dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	dentry_insert (dir, name, true, sector);
+}
+
+/* Records that DIR has no entry named NAME.  The caller must hold
+ * DIR's directory lock, as for dcache_insert(). */
+void
+dcache_insert_negative (disk_sector_t dir, const char *name) {
+	dentry_insert (dir, name, false, 0);
+}
+
+/* Forgets whatever is cached about NAME in DIR. */
+void
+dcache_invalidate (disk_sector_t dir, const char *name) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL)
+		dentry_drop (d);
+	lock_release (&dcache_lock);
+}
+
+/* Forgets every name cached for DIR, whose sector is about to hold
+ * a new directory. */
+void
+dcache_invalidate_dir (disk_sector_t dir) {
+	struct list_elem *e, *next;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&dcache_lru); e != list_end (&dcache_lru); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		next = list_next (e);
+		if (d->dir == dir)
+			dentry_drop (d);
+	}
+	lock_release (&dcache_lock);
+}
+
+/* Forgets every name cached for a directory of mount ID, which is
+ * being unmounted. */
+void
+dcache_invalidate_mount (int id) {
+	struct list_elem *e, *next;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&dcache_lru); e != list_end (&dcache_lru); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		next = list_next (e);
+		if (mount_id (d->dir) == id)
+			dentry_drop (d);
+	}
+	lock_release (&dcache_lock);
+}
+
+/* Prints dentry cache statistics. */
+void
+dcache_print_stats (void) {
+	printf ("Dentry cache: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
@@ -1,29 +1,139 @@
 #include "filesys/directory.h"
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/mount.h"
 #include "threads/malloc.h"
 
 /* A directory. */
 struct dir {
 	struct inode *inode;                /* Backing store. */
 	off_t pos;                          /* Current position. */
+	bool hashed;                        /* Hashed or linear format? */
 };
 
 /* A single directory entry. */
 struct dir_entry {
 	disk_sector_t inode_sector;         /* Sector number of header. */
 	char name[NAME_MAX + 1];            /* Null terminated file name. */
-	bool in_use;                        /* In use or free? */
+	uint8_t type;                       /* DT_REG or DT_DIR, or 0 if
+	                                       free. */
 };
 
+/* Hashed directories.
+ *
+ * A linear directory is just an array of dir_entry, searched from
+ * the start on every lookup.  A hashed directory starts with a
+ * dir_header sector instead.  Every later sector holds either
+ * bucket heads or DIR_SLOTS_PER_SECTOR dir_slots.  Each slot is an
+ * entry chained to the next one in its bucket.  Chain links and
+ * bucket heads are byte offsets of slots within the directory,
+ * with 0 meaning none, since offset 0 is the header.  Directories
+ * made by dir_create() are hashed; linear ones are still read and
+ * updated in their own format. */
+
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x48524944
+
+/* A directory entry in a bucket chain. */
+struct dir_slot {
+	struct dir_entry entry;             /* The entry itself. */
+	uint32_t next;                      /* Next slot in the bucket, or 0. */
+};
+
+#define DIR_BUCKETS_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (uint32_t))
+#define DIR_SLOTS_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (struct dir_slot))
+
+/* Maximum number of bucket sectors. */
+#define DIR_TABLE_MAX 120
+
+/* Average chain length above which the bucket table doubles. */
+#define DIR_MAX_LOAD 2
+
+/* Buckets split by each hashed_add() while the table doubles. */
+#define DIR_SPLIT_STEP 2
+
+/* Log sectors that appending a sector to a directory may take:
+ * the sector itself, the inode and its block map. */
+#define DIR_APPEND_LOG 4
+
+/* First sector of a hashed directory.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct dir_header {
+	uint32_t magic;                     /* DIR_MAGIC. */
+	uint32_t bucket_cnt;                /* Number of buckets, a power of 2. */
+	uint32_t entry_cnt;                 /* Entries in use. */
+	uint32_t free_slot;                 /* First free slot, or 0. */
+	uint32_t next_slot;                 /* Next never used slot, or 0. */
+	uint32_t table[DIR_TABLE_MAX];      /* Offsets of bucket sectors. */
+	uint32_t grow_from;                 /* Buckets before the table
+	                                       doubled, or 0 once all are
+	                                       split. */
+	uint32_t split_next;                /* Next bucket to split. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Appends a zeroed sector to DIR's INODE and returns its offset,
+ * or 0 if the disk is full. */
+static off_t
+dir_append_sector (struct inode *inode) {
+	static const char zeros[DISK_SECTOR_SIZE];
+	off_t ofs = inode_length (inode);
+
+	if (inode_write_at (inode, zeros, DISK_SECTOR_SIZE, ofs)
+			!= DISK_SECTOR_SIZE)
+		return 0;
+	return ofs;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	struct dir_header *h;
+	struct inode *inode;
+	bool success = false;
+	size_t i;
+
+	ASSERT (sizeof *h == DISK_SECTOR_SIZE);
+
+	/* Entries get space as they are added; ENTRY_CNT only sizes the
+	 * first bucket table. */
+	h = calloc (1, sizeof *h);
+	if (h == NULL || !inode_create (sector, 0))
+		goto done;
+
+	/* SECTOR may have held a directory that was removed. */
+	dcache_invalidate_dir (sector);
+	inode = inode_open (sector);
+	if (inode == NULL)
+		goto done;
+	inode_set_metadata (inode);
+
+	h->magic = DIR_MAGIC;
+	h->bucket_cnt = DIR_BUCKETS_PER_SECTOR;
+	while (h->bucket_cnt * DIR_MAX_LOAD < entry_cnt
+			&& h->bucket_cnt < DIR_TABLE_MAX / 2 * DIR_BUCKETS_PER_SECTOR)
+		h->bucket_cnt *= 2;
+	/* Reserve the header sector before laying out the table. */
+	if (inode_write_at (inode, h, sizeof *h, 0) != sizeof *h)
+		goto close;
+	for (i = 0; i < h->bucket_cnt / DIR_BUCKETS_PER_SECTOR; i++)
+		if ((h->table[i] = dir_append_sector (inode)) == 0)
+			goto close;
+	success = inode_write_at (inode, h, sizeof *h, 0) == sizeof *h;
+
+close:
+	inode_close (inode);
+done:
+	free (h);
+	return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -31,9 +141,14 @@ dir_create (disk_sector_t sector, size_t entry_cnt) {
 struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
+	uint32_t magic;
+
 	if (inode != NULL && dir != NULL) {
+		inode_set_metadata (inode);
 		dir->inode = inode;
 		dir->pos = 0;
+		dir->hashed = inode_read_at (inode, &magic, sizeof magic, 0)
+			== sizeof magic && magic == DIR_MAGIC;
 		return dir;
 	} else {
 		inode_close (inode);
@@ -46,7 +161,14 @@ dir_open (struct inode *inode) {
  * Return true if successful, false on failure. */
 struct dir *
 dir_open_root (void) {
-	return dir_open (inode_open (ROOT_DIR_SECTOR));
+	return dir_open_mount (0);
+}
+
+/* Opens the root directory of mount ID and returns a directory
+ * for it.  Returns a null pointer on failure. */
+struct dir *
+dir_open_mount (int id) {
+	return dir_open (inode_open (mount_sector (id, ROOT_DIR_SECTOR)));
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -71,6 +193,352 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Reads the header of hashed directory DIR into *H. */
+static bool
+header_read (const struct dir *dir, struct dir_header *h) {
+	return inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Writes *H back as the header of hashed directory DIR. */
+static bool
+header_write (struct dir *dir, const struct dir_header *h) {
+	return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns the offset of the head of BUCKET in the directory
+ * described by H. */
+static off_t
+bucket_ofs (const struct dir_header *h, uint32_t bucket) {
+	return h->table[bucket / DIR_BUCKETS_PER_SECTOR]
+		+ bucket % DIR_BUCKETS_PER_SECTOR * sizeof (uint32_t);
+}
+
+/* Returns the bucket of NAME in the directory described by H. */
+static uint32_t
+name_bucket (const struct dir_header *h, const char *name) {
+	uint32_t bucket = hash_string (name) & (h->bucket_cnt - 1);
+
+	/* An old bucket that is not split yet still holds the entries
+	 * of its upper half. */
+	if (h->grow_from != 0 && (bucket & (h->grow_from - 1)) >= h->split_next)
+		bucket &= h->grow_from - 1;
+	return bucket;
+}
+
+/* Makes room in the running journal operation for CNT more
+ * sectors of DIR.  Only the root file system is journaled. */
+static bool
+reserve_log (const struct dir *dir, size_t cnt) {
+	return mount_id (inode_get_inumber (dir->inode)) != 0
+		|| journal_reserve (cnt);
+}
+
+/* Reads the head of BUCKET into *HEAD. */
+static bool
+bucket_read (const struct dir *dir, const struct dir_header *h,
+		uint32_t bucket, uint32_t *head) {
+	return inode_read_at (dir->inode, head, sizeof *head,
+			bucket_ofs (h, bucket)) == sizeof *head;
+}
+
+/* Sets the head of BUCKET to HEAD. */
+static bool
+bucket_write (struct dir *dir, const struct dir_header *h,
+		uint32_t bucket, uint32_t head) {
+	return inode_write_at (dir->inode, &head, sizeof head,
+			bucket_ofs (h, bucket)) == sizeof head;
+}
+
+/* Reads the slot at OFS into *SLOT. */
+static bool
+slot_read (const struct dir *dir, off_t ofs, struct dir_slot *slot) {
+	return inode_read_at (dir->inode, slot, sizeof *slot, ofs)
+		== sizeof *slot;
+}
+
+/* Writes *SLOT to offset OFS. */
+static bool
+slot_write (struct dir *dir, off_t ofs, const struct dir_slot *slot) {
+	return inode_write_at (dir->inode, slot, sizeof *slot, ofs)
+		== sizeof *slot;
+}
+
+/* Searches the chain of NAME's bucket in hashed directory DIR.
+ * If successful, returns true and stores the slot into *SLOT, its
+ * offset into *OFSP and the offset of the previous slot in the
+ * chain, or 0, into *PREVP.  Pointers may be null. */
+static bool
+hashed_lookup (const struct dir *dir, const struct dir_header *h,
+		const char *name, struct dir_slot *slotp, off_t *ofsp, off_t *prevp) {
+	struct dir_slot slot;
+	uint32_t ofs, prev = 0;
+
+	if (!bucket_read (dir, h, name_bucket (h, name), &ofs))
+		return false;
+	for (; ofs != 0; prev = ofs, ofs = slot.next) {
+		if (!slot_read (dir, ofs, &slot))
+			return false;
+		if (slot.entry.type != 0 && !strcmp (name, slot.entry.name)) {
+			if (slotp != NULL)
+				*slotp = slot;
+			if (ofsp != NULL)
+				*ofsp = ofs;
+			if (prevp != NULL)
+				*prevp = prev;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* A slot of a chain being split. */
+struct split_slot {
+	uint32_t ofs;                       /* Offset of the slot. */
+	uint32_t next;                      /* Link after the split. */
+	struct dir_slot slot;               /* The slot as read. */
+};
+
+/* Rewrites the links of the first CNT slots of S that change, to
+ * their new values if NEW is true or back to the old ones
+ * otherwise. */
+static bool
+split_relink (struct dir *dir, struct split_slot *s, size_t cnt, bool new) {
+	bool success = true;
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		if (s[i].next != s[i].slot.next) {
+			struct dir_slot slot = s[i].slot;
+
+			if (new)
+				slot.next = s[i].next;
+			if (!slot_write (dir, s[i].ofs, &slot))
+				success = false;
+		}
+	return success;
+}
+
+/* Splits old bucket H->split_next of hashed directory DIR, moving
+ * the entries that belong in its upper half there, and writes the
+ * header that records it.  The chain is read in full first, and
+ * if it cannot all be rewritten it is put back as it was and false
+ * is returned, so that a later call tries the same bucket again.
+ * Also returns false, changing nothing, if the journal has no room
+ * for the split. */
+static bool
+bucket_split (struct dir *dir, struct dir_header *h) {
+	uint32_t b = h->split_next, upper = b + h->grow_from;
+	uint32_t head, ofs, heads[2] = { 0, 0 }, *links[2];
+	struct split_slot *s = NULL;
+	size_t cnt = 0, cap = 0, i;
+	bool success = false;
+
+	if (!bucket_read (dir, h, b, &head))
+		return false;
+	for (ofs = head; ofs != 0; ofs = s[cnt++].slot.next) {
+		if (cnt == cap) {
+			struct split_slot *t;
+
+			cap = cap != 0 ? 2 * cap : 8;
+			t = realloc (s, cap * sizeof *s);
+			if (t == NULL)
+				goto done;
+			s = t;
+		}
+		s[cnt].ofs = ofs;
+		if (!slot_read (dir, ofs, &s[cnt].slot))
+			goto done;
+	}
+
+	/* Every slot, both bucket heads and the header. */
+	if (!reserve_log (dir, cnt + 3))
+		goto done;
+
+	/* Entries of bucket B move to UPPER or stay, in chain order. */
+	links[0] = &heads[0];
+	links[1] = &heads[1];
+	for (i = 0; i < cnt; i++) {
+		int half = (hash_string (s[i].slot.entry.name)
+				& (h->bucket_cnt - 1)) != b;
+
+		*links[half] = s[i].ofs;
+		links[half] = &s[i].next;
+	}
+	*links[0] = *links[1] = 0;
+
+	if (++h->split_next == h->grow_from)
+		h->grow_from = h->split_next = 0;
+	success = split_relink (dir, s, cnt, true)
+		&& bucket_write (dir, h, b, heads[0])
+		&& bucket_write (dir, h, upper, heads[1])
+		&& header_write (dir, h);
+	if (!success) {
+		if (h->grow_from == 0)
+			h->grow_from = upper - b;
+		h->split_next = b;
+		split_relink (dir, s, cnt, false);
+		bucket_write (dir, h, b, head);
+		bucket_write (dir, h, upper, 0);
+		header_write (dir, h);
+	}
+
+done:
+	free (s);
+	return success;
+}
+
+/* Takes a step towards doubling the bucket table of hashed
+ * directory DIR, whose header is *H, if its chains are long or it
+ * is already doubling.  The sectors for the upper half of the
+ * table are appended one a step, then the table doubles with the
+ * upper buckets empty, and then the old buckets are split
+ * DIR_SPLIT_STEP a step.  Every step writes the header, so a table
+ * that stops part way still works and the next step goes on from
+ * there.  Returns false if no step was taken. */
+static bool
+hashed_grow (struct dir *dir, struct dir_header *h) {
+	uint32_t sectors = h->bucket_cnt / DIR_BUCKETS_PER_SECTOR;
+	uint32_t i;
+
+	if (h->grow_from != 0) {
+		for (i = 0; i < DIR_SPLIT_STEP && h->grow_from != 0; i++)
+			if (!bucket_split (dir, h))
+				return false;
+		return true;
+	}
+	if (h->entry_cnt < h->bucket_cnt * DIR_MAX_LOAD
+			|| 2 * sectors > DIR_TABLE_MAX)
+		return false;
+
+	/* Append the next missing sector of the upper half. */
+	for (i = sectors; i < 2 * sectors; i++)
+		if (h->table[i] == 0) {
+			off_t ofs;
+
+			if (!reserve_log (dir, DIR_APPEND_LOG + 1)
+					|| (ofs = dir_append_sector (dir->inode)) == 0)
+				return false;
+			h->table[i] = ofs;
+			if (!header_write (dir, h)) {
+				h->table[i] = 0;
+				return false;
+			}
+			return true;
+		}
+
+	/* All there, so double the table. */
+	if (!reserve_log (dir, 1))
+		return false;
+	h->grow_from = h->bucket_cnt;
+	h->split_next = 0;
+	h->bucket_cnt *= 2;
+	if (!header_write (dir, h)) {
+		h->bucket_cnt = h->grow_from;
+		h->grow_from = 0;
+		return false;
+	}
+	return true;
+}
+
+/* Adds NAME, whose inode is in INODE_SECTOR and whose entry type
+ * is TYPE, to hashed directory DIR. */
+static bool
+hashed_add (struct dir *dir, const char *name, disk_sector_t inode_sector,
+		uint8_t type) {
+	struct dir_header h;
+	struct dir_slot slot;
+	uint32_t bucket, ofs;
+
+	if (!header_read (dir, &h) || hashed_lookup (dir, &h, name, NULL, NULL,
+				NULL))
+		return false;
+
+	/* Keep chains short.  A table that cannot grow still works. */
+	hashed_grow (dir, &h);
+
+	/* Take a free slot, or the next unused one, starting a new slot
+	 * sector when the current one is full. */
+	if (h.free_slot != 0) {
+		ofs = h.free_slot;
+		if (!slot_read (dir, ofs, &slot))
+			return false;
+		h.free_slot = slot.next;
+	} else {
+		if (h.next_slot == 0 && (h.next_slot = dir_append_sector (dir->inode))
+				== 0)
+			return false;
+		ofs = h.next_slot;
+		h.next_slot += sizeof slot;
+		if (h.next_slot % DISK_SECTOR_SIZE
+				== DIR_SLOTS_PER_SECTOR * sizeof slot)
+			h.next_slot = 0;
+	}
+
+	bucket = name_bucket (&h, name);
+	memset (&slot, 0, sizeof slot);
+	slot.entry.type = type;
+	strlcpy (slot.entry.name, name, sizeof slot.entry.name);
+	slot.entry.inode_sector = inode_sector;
+	if (!bucket_read (dir, &h, bucket, &slot.next)
+			|| !slot_write (dir, ofs, &slot)
+			|| !bucket_write (dir, &h, bucket, ofs))
+		return false;
+	h.entry_cnt++;
+	return header_write (dir, &h);
+}
+
+/* Unlinks the slot for NAME from hashed directory DIR and stores
+ * its entry into *EP. */
+static bool
+hashed_remove (struct dir *dir, const char *name, struct dir_entry *ep) {
+	struct dir_header h;
+	struct dir_slot slot, prev_slot;
+	off_t ofs, prev;
+
+	if (!header_read (dir, &h)
+			|| !hashed_lookup (dir, &h, name, &slot, &ofs, &prev))
+		return false;
+
+	if (prev == 0) {
+		if (!bucket_write (dir, &h, name_bucket (&h, name), slot.next))
+			return false;
+	} else {
+		if (!slot_read (dir, prev, &prev_slot))
+			return false;
+		prev_slot.next = slot.next;
+		if (!slot_write (dir, prev, &prev_slot))
+			return false;
+	}
+
+	*ep = slot.entry;
+	slot.entry.type = 0;
+	slot.next = h.free_slot;
+	h.free_slot = ofs;
+	h.entry_cnt--;
+	return slot_write (dir, ofs, &slot) && header_write (dir, &h);
+}
+
+/* Returns true if OFS is the offset of one of the bucket sectors
+ * of the directory described by H, counting those appended for a
+ * table that has not doubled yet. */
+static bool
+is_bucket_sector (const struct dir_header *h, off_t ofs) {
+	uint32_t i;
+
+	for (i = 0; i < DIR_TABLE_MAX && h->table[i] != 0; i++)
+		if (h->table[i] == (uint32_t) ofs)
+			return true;
+	return false;
+}
+
+/* Returns the sector number of the inode of entry E of DIR.  An
+ * entry holds a sector of the disk DIR is on. */
+static disk_sector_t
+entry_sector (const struct dir *dir, const struct dir_entry *e) {
+	return mount_sector (mount_id (inode_get_inumber (dir->inode)),
+			e->inode_sector);
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
@@ -85,9 +553,24 @@ lookup (const struct dir *dir, const char *name,
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	if (dir->hashed) {
+		struct dir_header h;
+		struct dir_slot slot;
+		off_t slot_ofs;
+
+		if (!header_read (dir, &h)
+				|| !hashed_lookup (dir, &h, name, &slot, &slot_ofs, NULL))
+			return false;
+		if (ep != NULL)
+			*ep = slot.entry;
+		if (ofsp != NULL)
+			*ofsp = slot_ofs;
+		return true;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
+		if (e.type != 0 && !strcmp (name, e.name)) {
 			if (ep != NULL)
 				*ep = e;
 			if (ofsp != NULL)
@@ -104,38 +587,76 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector, sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	/* A cached answer needs no directory reads at all.  The inode
+	 * is opened under the directory lock, so that the entry cannot
+	 * be removed, and its inode freed, before it is open, and the
+	 * cache is filled under it, so that the entry cannot be added
+	 * or removed in between. */
+	dir_sector = inode_get_inumber (dir->inode);
+	inode_dir_lock (dir->inode);
+	switch (dcache_lookup (dir_sector, name, &sector)) {
+		case DCACHE_POSITIVE:
+			*inode = inode_open (sector);
+			break;
+		case DCACHE_NEGATIVE:
+			*inode = NULL;
+			break;
+		case DCACHE_MISS:
+			if (lookup (dir, name, &e, NULL)) {
+				sector = entry_sector (dir, &e);
+				dcache_insert (dir_sector, name, sector);
+				*inode = inode_open (sector);
+			} else {
+				dcache_insert_negative (dir_sector, name);
+				*inode = NULL;
+			}
+			break;
+	}
+	inode_dir_unlock (dir->inode);
 
 	return *inode != NULL;
 }
 
 /* Adds a file named NAME to DIR, which must not already contain a
  * file by that name.  The file's inode is in sector
- * INODE_SECTOR.
+ * INODE_SECTOR, and it is a directory if IS_DIR is true.
  * Returns true if successful, false on failure.
  * Fails if NAME is invalid (i.e. too long) or a disk or memory
  * error occurs. */
 bool
-dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector,
+		bool is_dir) {
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
+	ASSERT (mount_id (inode_sector)
+			== mount_id (inode_get_inumber (dir->inode)));
 
 	/* Check NAME for validity. */
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
+	journal_begin ();
+	inode_dir_lock (dir->inode);
+
+	/* Drop a cached negative entry, whatever happens below. */
+	dcache_invalidate (inode_get_inumber (dir->inode), name);
+
+	if (dir->hashed) {
+		success = hashed_add (dir, name, mount_disk_sector (inode_sector),
+				is_dir ? DT_DIR : DT_REG);
+		goto done;
+	}
+
 	/* Check that NAME is not in use. */
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
@@ -149,16 +670,18 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	 * read due to something intermittent such as low memory. */
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
-		if (!e.in_use)
+		if (e.type == 0)
 			break;
 
 	/* Write slot. */
-	e.in_use = true;
+	e.type = is_dir ? DT_DIR : DT_REG;
 	strlcpy (e.name, name, sizeof e.name);
-	e.inode_sector = inode_sector;
+	e.inode_sector = mount_disk_sector (inode_sector);
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+	inode_dir_unlock (dir->inode);
+	journal_end ();
 	return success;
 }
 
@@ -175,42 +698,152 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	journal_begin ();
+	inode_dir_lock (dir->inode);
+
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
 
 	/* Open inode. */
-	inode = inode_open (e.inode_sector);
+	inode = inode_open (entry_sector (dir, &e));
 	if (inode == NULL)
 		goto done;
 
 	/* Erase directory entry. */
-	e.in_use = false;
-	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
-		goto done;
+	if (dir->hashed) {
+		if (!hashed_remove (dir, name, &e))
+			goto done;
+	} else {
+		e.type = 0;
+		if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+			goto done;
+	}
 
 	/* Remove inode. */
+	dcache_insert_negative (inode_get_inumber (dir->inode), name);
 	inode_remove (inode);
 	success = true;
 
 done:
+	inode_dir_unlock (dir->inode);
 	inode_close (inode);
+	journal_end ();
 	return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
- * NAME.  Returns true if successful, false if the directory
- * contains no more entries. */
-bool
-dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
+ * NAME.  Must be called with DIR's directory lock held. */
+static bool
+readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
 
+	if (dir->hashed) {
+		struct dir_header h;
+		struct dir_slot slot;
+
+		if (!header_read (dir, &h))
+			return false;
+		for (;;) {
+			/* Skip the header, bucket sectors and sector padding. */
+			off_t sector_ofs = dir->pos % DISK_SECTOR_SIZE;
+			if (dir->pos < DISK_SECTOR_SIZE
+					|| is_bucket_sector (&h, dir->pos - sector_ofs)
+					|| sector_ofs == DIR_SLOTS_PER_SECTOR * sizeof slot) {
+				dir->pos += DISK_SECTOR_SIZE - sector_ofs;
+				continue;
+			}
+			if (!slot_read (dir, dir->pos, &slot))
+				return false;
+			dir->pos += sizeof slot;
+			if (slot.entry.type != 0) {
+				strlcpy (name, slot.entry.name, NAME_MAX + 1);
+				return true;
+			}
+		}
+	}
+
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
-		if (e.in_use) {
+		if (e.type != 0) {
 			strlcpy (name, e.name, NAME_MAX + 1);
 			return true;
 		}
 	}
 	return false;
 }
+
+/* Reads the next directory entry in DIR and stores the name in
+ * NAME.  Returns true if successful, false if the directory
+ * contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
+	bool success;
+
+	inode_dir_lock (dir->inode);
+	success = readdir (dir, name);
+	inode_dir_unlock (dir->inode);
+	return success;
+}
+
+/* Stores up to CNT of the entries that follow DIR's position into
+ * ENTS and advances the position past them.  Returns the number of
+ * entries stored, which is 0 at the end of the directory.  Reads
+ * the directory a sector at a time, instead of an entry at a time
+ * like dir_readdir(). */
+size_t
+dir_readdir_batch (struct dir *dir, struct dirent *ents, size_t cnt) {
+	struct dir_header h;
+	uint8_t *buf;
+	size_t n = 0;
+
+	buf = malloc (DISK_SECTOR_SIZE);
+	if (buf == NULL)
+		return 0;
+
+	inode_dir_lock (dir->inode);
+	if (dir->hashed && !header_read (dir, &h))
+		goto done;
+	while (n < cnt && dir->pos < inode_length (dir->inode)) {
+		off_t sector_ofs = dir->pos % DISK_SECTOR_SIZE;
+		size_t size, len, i;
+
+		/* Read the rest of the current slot sector, or as many
+		 * whole linear entries as fit in a sector. */
+		if (dir->hashed) {
+			size = sizeof (struct dir_slot);
+			len = DIR_SLOTS_PER_SECTOR * size;
+			if (dir->pos < DISK_SECTOR_SIZE
+					|| is_bucket_sector (&h, dir->pos - sector_ofs)
+					|| (size_t) sector_ofs >= len) {
+				dir->pos += DISK_SECTOR_SIZE - sector_ofs;
+				continue;
+			}
+			len -= sector_ofs;
+		} else {
+			size = sizeof (struct dir_entry);
+			len = DISK_SECTOR_SIZE / size * size;
+		}
+		len = inode_read_at (dir->inode, buf, len, dir->pos) / size;
+		if (len == 0)
+			break;
+
+		/* A slot starts with its entry. */
+		for (i = 0; i < len && n < cnt; i++) {
+			const struct dir_entry *e = (const void *) (buf + i * size);
+
+			dir->pos += size;
+			if (e->type != 0) {
+				ents[n].d_ino = entry_sector (dir, e);
+				ents[n].d_type = e->type;
+				strlcpy (ents[n].d_name, e->name, sizeof ents[n].d_name);
+				n++;
+			}
+		}
+	}
+
+done:
+	inode_dir_unlock (dir->inode);
+	free (buf);
+	return n;
+}
@@ -1,8 +1,14 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
+#include <round.h>
 #include "devices/disk.h"
+#include "devices/timer.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -24,12 +30,29 @@ struct fat_fs {
 	disk_sector_t data_start;
 	cluster_t last_clst;
 	struct lock write_lock;
+
+	/* Summary of free clusters, kept in sync by fat_put(). */
+	struct bitmap *used_map;    /* One bit per cluster, true if in use. */
+	unsigned int *region_free;  /* Free clusters in each region. */
+	size_t region_cnt;          /* Number of regions. */
+
+	/* FAT sectors changed since they were last written, one bit per
+	 * sector, set by fat_put(). */
+	struct bitmap *dirty_map;
 };
 
+/* How often dirty FAT sectors are written back, in timer ticks. */
+#define FAT_FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Clusters summarized by one entry of region_free. */
+#define FAT_REGION_SIZE 1024
+
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_summary_build (void);
+static void fat_flushd (void *aux);
 
 void
 fat_init (void) {
@@ -51,32 +74,78 @@ fat_init (void) {
 	fat_fs_init ();
 }
 
+/* Allocates a zeroed in-memory FAT, sized to whole FAT sectors so
+ * that it can be read and written without bounce buffers, and a
+ * clean dirty map. */
+static void
+fat_table_alloc (void) {
+	free (fat_fs->fat);
+	bitmap_destroy (fat_fs->dirty_map);
+
+	fat_fs->fat = calloc (fat_fs->bs.fat_sectors, DISK_SECTOR_SIZE);
+	fat_fs->dirty_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->fat == NULL || fat_fs->dirty_map == NULL)
+		PANIC ("FAT allocation failed");
+}
+
 void
 fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT load failed");
-
-	// Load FAT directly from the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
+	static bool flushd_started;
+
+	fat_table_alloc ();
+
+	// Load FAT directly from the disk, in as few commands as possible
+	disk_read_multiple (filesys_disk, fat_fs->bs.fat_start, fat_fs->fat,
+			fat_fs->bs.fat_sectors);
+	fat_summary_build ();
+
+	if (!flushd_started) {
+		if (thread_create ("fat_flushd", PRI_DEFAULT, fat_flushd, NULL)
+				== TID_ERROR)
+			PANIC ("FAT flush daemon creation failed");
+		flushd_started = true;
+	}
+}
+
+/* Writes the FAT sectors changed since they were last written, as
+ * metadata logged in the journal. */
+void
+fat_flush (void) {
+	uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+	size_t i;
+
+	if (bounce == NULL)
+		PANIC ("FAT flush failed");
+
+	for (i = 0; i < fat_fs->bs.fat_sectors; i++) {
+		/* Copy the sector under the lock, so that it is never written
+		 * halfway through an update, but write it outside. */
+		lock_acquire (&fat_fs->write_lock);
+		if (!bitmap_test (fat_fs->dirty_map, i)) {
+			lock_release (&fat_fs->write_lock);
+			continue;
 		}
+		bitmap_reset (fat_fs->dirty_map, i);
+		journal_map_clean (1);
+		memcpy (bounce, (uint8_t *) fat_fs->fat + i * DISK_SECTOR_SIZE,
+				DISK_SECTOR_SIZE);
+		lock_release (&fat_fs->write_lock);
+
+		buffer_cache_write_meta (fat_fs->bs.fat_start + i, bounce, 0,
+				DISK_SECTOR_SIZE);
+	}
+	free (bounce);
+}
+
+/* Flushes dirty FAT sectors every FAT_FLUSH_INTERVAL ticks, as
+ * one journal operation. */
+static void
+fat_flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FAT_FLUSH_INTERVAL);
+		journal_begin ();
+		fat_flush ();
+		journal_end ();
 	}
 }
 
@@ -90,27 +159,10 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
-	}
+	// Write the changed part of the FAT
+	journal_begin ();
+	fat_flush ();
+	journal_end ();
 }
 
 void
@@ -119,13 +171,13 @@ fat_create (void) {
 	fat_boot_create ();
 	fat_fs_init ();
 
-	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT creation failed");
-
-	// Set up ROOT_DIR_CLST
-	fat_put (ROOT_DIR_CLUSTER, EOChain);
+	// Create FAT table with ROOT_DIR_CLST set up, and write all of
+	// it straight to disk: it is far too big to log
+	fat_table_alloc ();
+	fat_fs->fat[ROOT_DIR_CLUSTER] = EOChain;
+	fat_summary_build ();
+	disk_write_multiple (filesys_disk, fat_fs->bs.fat_start, fat_fs->fat,
+			fat_fs->bs.fat_sectors);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
@@ -137,13 +189,15 @@ fat_create (void) {
 
 void
 fat_boot_create (void) {
+	/* The journal takes the end of the disk. */
+	disk_sector_t total_sectors = disk_size (filesys_disk) - JOURNAL_SECTORS;
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
+	    (total_sectors - 1)
 	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
 	fat_fs->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
 	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
-	    .total_sectors = disk_size (filesys_disk),
+	    .total_sectors = total_sectors,
 	    .fat_start = 1,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
@@ -152,42 +206,336 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+
+	/* Entry 0 is never a cluster: 0 marks a free entry and an empty
+	 * chain, so clusters are numbered from 1. */
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* (Re)builds the free cluster summary from the loaded FAT. */
+static void
+fat_summary_build (void) {
+	cluster_t clst;
+
+	bitmap_destroy (fat_fs->used_map);
+	free (fat_fs->region_free);
+
+	fat_fs->region_cnt = DIV_ROUND_UP (fat_fs->fat_length, FAT_REGION_SIZE);
+	fat_fs->used_map = bitmap_create (fat_fs->fat_length);
+	fat_fs->region_free = calloc (fat_fs->region_cnt,
+			sizeof *fat_fs->region_free);
+	if (fat_fs->used_map == NULL || fat_fs->region_free == NULL)
+		PANIC ("FAT summary creation failed");
+
+	/* Entry 0 is not a cluster and never handed out. */
+	bitmap_mark (fat_fs->used_map, 0);
+	for (clst = 1; clst < fat_fs->fat_length; clst++) {
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used_map, clst);
+		else
+			fat_fs->region_free[clst / FAT_REGION_SIZE]++;
+	}
+}
+
+/* Returns a free cluster, or 0 if there is none.  Prefers the
+ * cluster right after PREV, if PREV is not 0, so that chains stay
+ * contiguous; otherwise continues from the last cluster handed out
+ * (next fit), skipping regions that have no free cluster.
+ * Must be called with write_lock held. */
+static cluster_t
+fat_find_free (cluster_t prev) {
+	struct fat_fs *fs = fat_fs;
+	size_t start, i;
+
+	if (prev != 0 && prev + 1 < fs->fat_length
+			&& !bitmap_test (fs->used_map, prev + 1))
+		return prev + 1;
+
+	/* The region holding START is visited twice: from START on
+	 * first, and in full once the search has wrapped around. */
+	start = (fs->last_clst + 1) % fs->fat_length;
+	for (i = 0; i <= fs->region_cnt; i++) {
+		size_t region = (start / FAT_REGION_SIZE + i) % fs->region_cnt;
+		size_t from = i == 0 ? start : region * FAT_REGION_SIZE;
+		size_t end = (region + 1) * FAT_REGION_SIZE;
+		size_t clst;
+
+		if (fs->region_free[region] == 0)
+			continue;
+		clst = bitmap_scan (fs->used_map, from, 1, false);
+		if (clst != BITMAP_ERROR && clst < end)
+			return clst;
+	}
+	return 0;
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Returns the FAT sector that holds the entry of CLST. */
+static size_t
+fat_sector_of (cluster_t clst) {
+	return clst * sizeof (cluster_t) / DISK_SECTOR_SIZE;
+}
+
+/* Sets aside room in the running journal operation for the FAT
+ * sectors that changing the entries of A and B, if B is not 0,
+ * dirties.  Returns false if the transaction has no room left.
+ * Must be called with write_lock held. */
+static bool
+fat_reserve (cluster_t a, cluster_t b) {
+	size_t cnt = 0;
+
+	if (!bitmap_test (fat_fs->dirty_map, fat_sector_of (a)))
+		cnt++;
+	if (b != 0 && fat_sector_of (b) != fat_sector_of (a)
+			&& !bitmap_test (fat_fs->dirty_map, fat_sector_of (b)))
+		cnt++;
+	return cnt == 0 || journal_reserve (cnt);
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
- * Returns 0 if fails to allocate a new cluster. */
+ * Returns 0 if fails to allocate a new cluster, or if the running
+ * journal transaction has no room for the change. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new_clst;
+
+	lock_acquire (&fat_fs->write_lock);
+	new_clst = fat_find_free (clst);
+	if (new_clst != 0 && !fat_reserve (new_clst, clst))
+		new_clst = 0;
+	if (new_clst != 0) {
+		fat_put (new_clst, EOChain);
+		if (clst != 0)
+			fat_put (clst, new_clst);
+		fat_fs->last_clst = new_clst;
+	}
+
+	lock_release (&fat_fs->write_lock);
+	return new_clst;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	while (clst != EOChain) {
+		cluster_t next = fat_get (clst);
+		journal_revoke (cluster_to_sector (clst), SECTORS_PER_CLUSTER);
+		fat_put (clst, 0);
+		clst = next;
+	}
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	lock_release (&fat_fs->write_lock);
+}
+
+/* Frees the clusters of the chain that starts at CLST from its
+ * start on, for as long as the running journal transaction has
+ * room for the FAT sectors this dirties.  Returns the first
+ * cluster left in the chain, or EOChain if all were freed. */
+static cluster_t
+fat_remove_prefix (cluster_t clst) {
+	lock_acquire (&fat_fs->write_lock);
+	while (clst != EOChain && fat_reserve (clst, 0)) {
+		cluster_t next = fat_get (clst);
+		journal_revoke (cluster_to_sector (clst), SECTORS_PER_CLUSTER);
+		fat_put (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
+	return clst;
 }
 
-/* Update a value in the FAT table. */
+/* Update a value in the FAT table, and the free cluster summary
+ * when CLST becomes used or free.
+ * Callers that may race with each other hold write_lock. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	if ((fat_fs->fat[clst] == 0) != (val == 0)) {
+		bitmap_set (fat_fs->used_map, clst, val != 0);
+		if (val != 0)
+			fat_fs->region_free[clst / FAT_REGION_SIZE]--;
+		else
+			fat_fs->region_free[clst / FAT_REGION_SIZE]++;
+	}
+	fat_fs->fat[clst] = val;
+	if (!bitmap_test (fat_fs->dirty_map, fat_sector_of (clst))) {
+		bitmap_mark (fat_fs->dirty_map, fat_sector_of (clst));
+		journal_map_dirty (1);
+	}
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts a sector number in the data area to its cluster #. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Chain index                                                                */
+/*----------------------------------------------------------------------------*/
+
+/* Initializes CHAIN as an index of the cluster chain that starts
+ * at START, or of an empty chain if START is 0.  Nothing is read
+ * until the chain is first searched. */
+void
+fat_chain_init (struct fat_chain *chain, cluster_t start) {
+	chain->start = start;
+	chain->checkpoints = NULL;
+	chain->checkpoint_cnt = 0;
+	chain->checkpoint_cap = 0;
+	chain->last_idx = 0;
+	chain->last_clst = 0;
+	chain->length = 0;
+	chain->tail = 0;
+}
+
+/* Frees the memory held by CHAIN.  The chain itself is untouched. */
+void
+fat_chain_destroy (struct fat_chain *chain) {
+	free (chain->checkpoints);
+	fat_chain_init (chain, 0);
+}
+
+/* Records CLST, which must be cluster #(CHAIN->checkpoint_cnt *
+ * FAT_CHAIN_STRIDE), as the next checkpoint.  Failing to allocate
+ * memory only leaves the index coarser, so it is not reported. */
+static void
+chain_checkpoint (struct fat_chain *chain, cluster_t clst) {
+	if (chain->checkpoint_cnt == chain->checkpoint_cap) {
+		size_t cap = chain->checkpoint_cap > 0 ? 2 * chain->checkpoint_cap : 8;
+		cluster_t *checkpoints = realloc (chain->checkpoints,
+				cap * sizeof *checkpoints);
+		if (checkpoints == NULL)
+			return;
+		chain->checkpoints = checkpoints;
+		chain->checkpoint_cap = cap;
+	}
+	chain->checkpoints[chain->checkpoint_cnt++] = clst;
+}
+
+/* Follows CHAIN towards cluster #IDX, starting from the closest
+ * known cluster at or before it: the last cluster visited when IDX
+ * lies less than FAT_CHAIN_STRIDE clusters past it, otherwise the
+ * nearest checkpoint.  Checkpoints passed for the first time are
+ * recorded.  Stops early at the end of the chain.  Leaves the
+ * cluster reached in CHAIN->last_clst and returns its index. */
+static size_t
+chain_walk (struct fat_chain *chain, size_t idx) {
+	size_t pos;
+	cluster_t clst;
+
+	ASSERT (chain->start != 0);
+
+	if (chain->checkpoint_cnt == 0)
+		chain_checkpoint (chain, chain->start);
+
+	if (chain->last_clst != 0 && chain->last_idx <= idx
+			&& idx - chain->last_idx < FAT_CHAIN_STRIDE) {
+		pos = chain->last_idx;
+		clst = chain->last_clst;
+	} else if (chain->checkpoint_cnt > 0) {
+		size_t cp = idx / FAT_CHAIN_STRIDE;
+		if (cp >= chain->checkpoint_cnt)
+			cp = chain->checkpoint_cnt - 1;
+		pos = cp * FAT_CHAIN_STRIDE;
+		clst = chain->checkpoints[cp];
+	} else {
+		pos = 0;
+		clst = chain->start;
+	}
+
+	while (pos < idx) {
+		cluster_t next = fat_get (clst);
+		if (next == EOChain)
+			break;
+		clst = next;
+		pos++;
+		if (pos == chain->checkpoint_cnt * FAT_CHAIN_STRIDE)
+			chain_checkpoint (chain, clst);
+	}
+
+	chain->last_idx = pos;
+	chain->last_clst = clst;
+	return pos;
+}
+
+/* Returns cluster #IDX of CHAIN, counting from 0, or 0 if the
+ * chain is not that long.  Sequential lookups follow one FAT link
+ * each; any other lookup follows fewer than FAT_CHAIN_STRIDE. */
+cluster_t
+fat_chain_seek (struct fat_chain *chain, size_t idx) {
+	if (chain->start == 0 || chain_walk (chain, idx) != idx)
+		return 0;
+	return chain->last_clst;
+}
+
+/* Returns the number of clusters in CHAIN.  The first call walks
+ * the rest of the chain; later ones are O(1). */
+size_t
+fat_chain_length (struct fat_chain *chain) {
+	if (chain->start != 0 && chain->tail == 0) {
+		chain->length = chain_walk (chain, SIZE_MAX) + 1;
+		chain->tail = chain->last_clst;
+	}
+	return chain->length;
+}
+
+/* Appends a newly allocated cluster to CHAIN and returns it, or
+ * returns 0 if the disk is full. */
+cluster_t
+fat_chain_extend (struct fat_chain *chain) {
+	size_t length = fat_chain_length (chain);
+	cluster_t clst = fat_create_chain (chain->tail);
+
+	if (clst == 0)
+		return 0;
+	if (chain->start == 0)
+		chain->start = clst;
+	if (length == chain->checkpoint_cnt * FAT_CHAIN_STRIDE)
+		chain_checkpoint (chain, clst);
+	chain->length = length + 1;
+	chain->tail = clst;
+	return clst;
+}
+
+/* Frees the clusters of CHAIN from its start on, for as long as
+ * the running journal transaction has room for the change, and
+ * leaves CHAIN holding the rest.  Returns true if CHAIN is empty
+ * now. */
+bool
+fat_chain_release (struct fat_chain *chain) {
+	cluster_t rest = chain->start != 0 ? fat_remove_prefix (chain->start)
+		: EOChain;
+
+	fat_chain_destroy (chain);
+	if (rest == EOChain)
+		return true;
+	fat_chain_init (chain, rest);
+	return false;
 }
@@ -1,13 +1,26 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/disk.h"
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 
+/* Readahead window bounds, in bytes. */
+#define READAHEAD_MIN (2 * DISK_SECTOR_SIZE)
+#define READAHEAD_MAX (32 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	int ref_cnt;                /* References, each dropped by
+	                               file_close(). */
+
+	/* Readahead state. */
+	off_t ra_next;              /* Position a sequential read starts at. */
+	off_t ra_window;            /* Bytes to prefetch; 0 while random. */
+	off_t ra_end;               /* End of the range prefetched so far. */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -20,6 +33,10 @@ file_open (struct inode *inode) {
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->ref_cnt = 1;
+		file->ra_next = 0;
+		file->ra_window = 0;
+		file->ra_end = 0;
 		return file;
 	} else {
 		inode_close (inode);
@@ -48,10 +65,28 @@ file_duplicate (struct file *file) {
 	return nfile;
 }
 
-/* Closes FILE. */
+/* Takes another reference to FILE and returns FILE.  Unlike
+ * file_reopen(), the position is shared.  FILE stays open until
+ * every reference is dropped with file_close(). */
+struct file *
+file_ref (struct file *file) {
+	enum intr_level old_level = intr_disable ();
+
+	file->ref_cnt++;
+	intr_set_level (old_level);
+	return file;
+}
+
+/* Drops a reference to FILE, closing it if it was the last. */
 void
 file_close (struct file *file) {
 	if (file != NULL) {
+		enum intr_level old_level = intr_disable ();
+		bool last = --file->ref_cnt == 0;
+
+		intr_set_level (old_level);
+		if (!last)
+			return;
 		file_allow_write (file);
 		inode_close (file->inode);
 		free (file);
@@ -71,8 +106,33 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
-	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	off_t bytes_read;
+
+	/* Reads that continue where the last one stopped grow the
+	 * readahead window; any other read collapses it. */
+	if (file->pos == file->ra_next) {
+		file->ra_window = file->ra_window == 0 ? READAHEAD_MIN
+			: file->ra_window * 2;
+		if (file->ra_window > READAHEAD_MAX)
+			file->ra_window = READAHEAD_MAX;
+	} else {
+		file->ra_window = 0;
+		file->ra_end = 0;
+	}
+
+	bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
+	file->ra_next = file->pos;
+
+	/* Prefetch the part of the next window not requested yet. */
+	if (file->ra_window > 0 && bytes_read > 0) {
+		off_t start = file->ra_end > file->pos ? file->ra_end : file->pos;
+		off_t end = file->pos + file->ra_window;
+		if (start < end) {
+			inode_readahead (file->inode, start, end - start);
+			file->ra_end = end;
+		}
+	}
 	return bytes_read;
 }
 
@@ -88,10 +148,9 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
+ * Writing past end of file grows the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
@@ -102,10 +161,9 @@ file_write (struct file *file, const void *buffer, off_t size) {
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
+ * Writing past end of file grows the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -113,6 +171,16 @@ file_write_at (struct file *file, const void *buffer, off_t size,
 	return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Grows FILE to SIZE bytes, if it is shorter, and sets aside
+ * contiguous disk space for the part of it not yet written, for a
+ * caller about to write it from start to end.
+ * Returns false if the disk is full. */
+bool
+file_preallocate (struct file *file, off_t size) {
+	ASSERT (file != NULL);
+	return inode_preallocate (file->inode, size);
+}
+
 /* Prevents write operations on FILE's underlying inode
  * until file_allow_write() is called or FILE is closed. */
 void
@@ -2,16 +2,24 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "filesys/fsck.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "filesys/mount.h"
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
 
 static void do_format (void);
+#ifndef EFILESYS
+static void mount_format (struct mount *);
+#endif
 
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
@@ -21,7 +29,11 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	mount_init (filesys_disk);
+	buffer_cache_init ();
+	journal_init (format);
 	inode_init ();
+	dcache_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -32,12 +44,15 @@ filesys_init (bool format) {
 	fat_open ();
 #else
 	/* Original FS */
-	free_map_init ();
+	if (!free_map_init (mount_get (0)))
+		PANIC ("free map creation failed");
 
 	if (format)
 		do_format ();
 
-	free_map_open ();
+	if (!free_map_open (mount_get (0)))
+		PANIC ("can't read free map");
+	fsck_run ();
 #endif
 }
 
@@ -45,12 +60,81 @@ filesys_init (bool format) {
  * to disk. */
 void
 filesys_done (void) {
+	inode_flush ();
+
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
-	free_map_close ();
+	{
+		int id;
+
+		/* Other mounts are not journaled: their free maps only reach
+		 * the disk when synced. */
+		for (id = 1; id < MOUNT_MAX; id++)
+			if (mount_used (id))
+				free_map_sync (mount_get (id));
+	}
+	free_map_close (mount_get (0));
 #endif
+	journal_close ();
+}
+
+/* Returns PATH past any leading slashes. */
+static const char *
+skip_slashes (const char *path) {
+	while (*path == '/')
+		path++;
+	return path;
+}
+
+/* Opens the root directory of the mount whose mount point is NAME,
+ * or the root directory of the root file system if NAME is empty.
+ * Returns a null pointer if there is no such mount. */
+static struct dir *
+open_mount_root (const char *name) {
+	struct dir *dir = NULL;
+	int id;
+
+	if (*name == '\0')
+		return dir_open_root ();
+
+	/* Open the directory under the lock, so that the mount is busy
+	 * before it can be unmounted. */
+	mount_lock ();
+	id = mount_find (name);
+	if (id != -1)
+		dir = dir_open_mount (id);
+	mount_unlock ();
+	return dir;
+}
+
+/* Splits PATH, which is "NAME" or "MOUNT/NAME", either one
+ * optionally preceded by "/", into the directory that holds NAME,
+ * which is returned opened, and NAME, which is copied into
+ * NAME_BUF.  Returns a null pointer if PATH is not of that form or
+ * MOUNT is not a mount point. */
+static struct dir *
+resolve (const char *path, char name_buf[NAME_MAX + 1]) {
+	char mount_name[NAME_MAX + 1];
+	const char *slash;
+
+	path = skip_slashes (path);
+	slash = strchr (path, '/');
+	if (slash == NULL) {
+		mount_name[0] = '\0';
+	} else {
+		if ((size_t) (slash - path) > NAME_MAX)
+			return NULL;
+		strlcpy (mount_name, path, slash - path + 1);
+		path = slash + 1;
+		if (*path == '\0' || strchr (path, '/') != NULL)
+			return NULL;
+	}
+	if (strlen (path) > NAME_MAX)
+		return NULL;
+	strlcpy (name_buf, path, NAME_MAX + 1);
+	return open_mount_root (mount_name);
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -58,16 +142,34 @@ filesys_done (void) {
  * Fails if a file named NAME already exists,
  * or if internal memory allocation fails. */
 bool
-filesys_create (const char *name, off_t initial_size) {
+filesys_create (const char *path, off_t initial_size) {
+	char name[NAME_MAX + 1];
 	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
+	struct dir *dir;
+
+	/* Resolve the path before the journal operation starts, since
+	 * the mount lock is never taken inside one. */
+	dir = resolve (path, name);
+	journal_begin ();
+#ifdef EFILESYS
+	cluster_t inode_clst = dir != NULL ? fat_create_chain (0) : 0;
+	bool success = (inode_clst != 0
+			&& inode_create (inode_sector = cluster_to_sector (inode_clst),
+				initial_size)
+			&& dir_add (dir, name, inode_sector, false));
+	if (!success && inode_clst != 0)
+		fat_remove_chain (inode_clst, 0);
+#else
 	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
+			&& free_map_allocate (mount_of (inode_get_inumber (
+						dir_get_inode (dir))), 1, &inode_sector)
 			&& inode_create (inode_sector, initial_size)
-			&& dir_add (dir, name, inode_sector));
+			&& dir_add (dir, name, inode_sector, false));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
+#endif
 	dir_close (dir);
+	journal_end ();
 
 	return success;
 }
@@ -78,8 +180,9 @@ filesys_create (const char *name, off_t initial_size) {
  * Fails if no file named NAME exists,
  * or if an internal memory allocation fails. */
 struct file *
-filesys_open (const char *name) {
-	struct dir *dir = dir_open_root ();
+filesys_open (const char *path) {
+	char name[NAME_MAX + 1];
+	struct dir *dir = resolve (path, name);
 	struct inode *inode = NULL;
 
 	if (dir != NULL)
@@ -94,14 +197,199 @@ filesys_open (const char *name) {
  * Fails if no file named NAME exists,
  * or if an internal memory allocation fails. */
 bool
-filesys_remove (const char *name) {
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+filesys_remove (const char *path) {
+	char name[NAME_MAX + 1];
+	struct dir *dir;
+	bool success;
+
+	dir = resolve (path, name);
+	journal_begin ();
+	success = dir != NULL && dir_remove (dir, name);
 	dir_close (dir);
+	journal_end ();
 
 	return success;
 }
 
+/* Opens the directory PATH, which is "/" or a mount point.
+ * Returns a null pointer if there is no such directory. */
+struct dir *
+filesys_open_dir (const char *path) {
+	path = skip_slashes (path);
+	if (strchr (path, '/') != NULL)
+		return NULL;
+	return open_mount_root (path);
+}
+
+#ifndef EFILESYS
+/* Name under which filesys_mkfs() mounts the disk it formats.  No
+ * mount point given by a user program can contain a slash. */
+#define MKFS_NAME "/"
+
+/* Returns true if the disk at channel CHAN, device DEV, may hold a
+ * mounted file system.  hd0:0 holds the kernel, hd0:1 the root file
+ * system, hd1:0 is the scratch disk and hd1:1 the swap disk, and
+ * none of them may. */
+static bool
+disk_mountable (int chan, int dev) {
+	return chan > 1 && (dev == 0 || dev == 1);
+}
+
+/* Adds the file system on the disk at CHAN:DEV to the mount table
+ * under NAME, formatting the disk first if FORMAT is true, and
+ * returns its mount index.  Returns -1 if the disk is not mountable
+ * or does not exist, is mounted already, holds no file system and
+ * FORMAT is false, or if NAME is taken or memory runs out.  Must be
+ * called with the mount lock held. */
+static int
+attach_disk (const char *name, int chan, int dev, bool format) {
+	struct disk *disk;
+	struct mount *mnt;
+	int id;
+
+	if (!disk_mountable (chan, dev))
+		return -1;
+	disk = disk_get (chan, dev);
+	if (disk == NULL || disk_size (disk) >= 1u << MOUNT_SECTOR_BITS)
+		return -1;
+
+	if (mount_find (name) != -1 || (id = mount_add (name, disk)) == -1)
+		return -1;
+	mnt = mount_get (id);
+	if (!buffer_cache_attach (id, disk))
+		goto fail_remove;
+	if (!free_map_init (mnt))
+		goto fail_detach;
+
+	if (format)
+		mount_format (mnt);
+	else if (!inode_valid (mount_sector (id, FREE_MAP_SECTOR))
+			|| !free_map_open (mnt))
+		goto fail_destroy;
+	return id;
+
+fail_destroy:
+	free_map_destroy (mnt);
+fail_detach:
+	buffer_cache_detach (id);
+fail_remove:
+	mount_remove (id);
+	return -1;
+}
+
+/* Writes mount ID back to its disk and removes it, unless a file on
+ * it is still open.  Must be called with the mount lock held.
+ * Returns true if successful. */
+static bool
+unmount (int id) {
+	struct mount *mnt = mount_get (id);
+
+	/* Files on the mount are only opened with the mount lock held,
+	 * or through a directory of it that is open already, so the
+	 * mount cannot become busy once it is found idle.  Only its
+	 * free map file may be open. */
+	if (inode_mount_cnt (id) != 1)
+		return false;
+	free_map_close (mnt);
+	ASSERT (inode_mount_cnt (id) == 0);
+	free_map_destroy (mnt);
+	dcache_invalidate_mount (id);
+	buffer_cache_detach (id);
+	mount_remove (id);
+	return true;
+}
+#endif
+
+/* Mounts the file system on the disk at channel CHAN, device DEV,
+ * at mount point PATH, a name in the root directory that files on
+ * the mount are opened under.  The disk must already hold a file
+ * system; only filesys_mkfs() makes one.
+ * Returns true if successful, false if PATH is taken or invalid,
+ * the disk does not exist, is reserved for the kernel, is mounted
+ * already or holds no file system, or memory runs out. */
+#ifdef EFILESYS
+bool
+filesys_mount (const char *path UNUSED, int chan UNUSED, int dev UNUSED) {
+	/* The FAT is a single instance for the root file system. */
+	return false;
+}
+#else
+bool
+filesys_mount (const char *path, int chan, int dev) {
+	int id;
+
+	path = skip_slashes (path);
+	if (*path == '\0' || strlen (path) > NAME_MAX
+			|| strchr (path, '/') != NULL)
+		return false;
+
+	mount_lock ();
+	id = attach_disk (path, chan, dev, false);
+	mount_unlock ();
+	return id != -1;
+}
+#endif
+
+/* Unmounts the file system mounted at PATH, writing it back to its
+ * disk.  Returns false if PATH is not a mount point or a file on
+ * the mount is still open. */
+#ifdef EFILESYS
+bool
+filesys_umount (const char *path UNUSED) {
+	return false;
+}
+#else
+bool
+filesys_umount (const char *path) {
+	bool success;
+	int id;
+
+	path = skip_slashes (path);
+	mount_lock ();
+	id = *path != '\0' ? mount_find (path) : -1;
+	success = id != -1 && unmount (id);
+	mount_unlock ();
+	return success;
+}
+#endif
+
+/* Makes a new, empty file system on the disk at channel CHAN,
+ * device DEV, which may then be mounted.  Whatever the disk held is
+ * lost.  Returns false if the disk cannot be mounted, is mounted
+ * already, or memory runs out. */
+#ifdef EFILESYS
+bool
+filesys_mkfs (int chan UNUSED, int dev UNUSED) {
+	return false;
+}
+#else
+bool
+filesys_mkfs (int chan, int dev) {
+	bool success;
+	int id;
+
+	mount_lock ();
+	id = attach_disk (MKFS_NAME, chan, dev, true);
+	success = id != -1 && unmount (id);
+	mount_unlock ();
+	return success;
+}
+#endif
+
+#ifndef EFILESYS
+/* Formats the file system of MNT, which is not the root, leaving
+ * its free map open. */
+static void
+mount_format (struct mount *mnt) {
+	printf ("Formatting file system...");
+	free_map_create (mnt);
+	if (!dir_create (mount_sector (mnt->id, ROOT_DIR_SECTOR), 16))
+		PANIC ("root directory creation failed");
+	free_map_sync (mnt);
+	printf ("done.\n");
+}
+#endif
+
 /* Formats the file system. */
 static void
 do_format (void) {
@@ -110,13 +398,19 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
-	free_map_create ();
+	free_map_create (mount_get (0));
 	if (!dir_create (ROOT_DIR_SECTOR, 16))
 		PANIC ("root directory creation failed");
-	free_map_close ();
+	free_map_close (mount_get (0));
 #endif
 
+	/* Put the new file system in place before it is opened. */
+	journal_commit ();
+	buffer_cache_flush ();
+
 	printf ("done.\n");
 }
@@ -1,77 +1,314 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/mount.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
-static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+/* The free map of one mounted file system.  Sector numbers inside
+ * it are sectors of the mount's disk. */
+struct free_map {
+	int mount_id;                       /* Mount it allocates for. */
+	struct file *file;                  /* Free map file. */
+	struct bitmap *map;                 /* One bit per disk sector. */
+	size_t free_cnt;                    /* Number of free sectors. */
+	size_t reserved_cnt;                /* Free sectors promised by
+	                                       free_map_reserve(). */
 
-/* Initializes the free map. */
-void
-free_map_init (void) {
-	free_map = bitmap_create (disk_size (filesys_disk));
-	if (free_map == NULL)
-		PANIC ("bitmap creation failed--disk is too large");
-	bitmap_mark (free_map, FREE_MAP_SECTOR);
-	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	/* Free map file sectors changed since they were last written,
+	 * one bit per sector.  Written back by free_map_sync(). */
+	struct bitmap *dirty_map;
+
+	/* Protects the map, the counts and DIRTY_MAP, so that files
+	 * being extended concurrently allocate distinct sectors. */
+	struct lock lock;
+};
+
+/* Bits of the free map held by one sector of the free map file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+
+/* Records that the bits of FM for CNT sectors starting at SECTOR
+ * changed.  The root file system's journal counts the free map
+ * sectors that became dirty, since its next commit logs them. */
+static void
+mark_dirty (struct free_map *fm, disk_sector_t sector, size_t cnt) {
+	size_t first = sector / BITS_PER_SECTOR;
+	size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+	size_t i, new_cnt = 0;
+
+	if (cnt == 0)
+		return;
+	for (i = first; i <= last; i++)
+		if (!bitmap_test (fm->dirty_map, i)) {
+			bitmap_mark (fm->dirty_map, i);
+			new_cnt++;
+		}
+	if (fm->mount_id == 0 && new_cnt > 0)
+		journal_map_dirty (new_cnt);
+}
+
+/* Clears bit I of FM's DIRTY_MAP and returns its old value.
+ * Must be called with FM's lock held. */
+static bool
+take_dirty (struct free_map *fm, size_t i) {
+	if (!bitmap_test (fm->dirty_map, i))
+		return false;
+	bitmap_reset (fm->dirty_map, i);
+	if (fm->mount_id == 0)
+		journal_map_clean (1);
+	return true;
+}
+
+/* Initializes the free map of MNT.  Only the root file system has
+ * room for the journal.
+ * Returns false if memory allocation fails. */
+bool
+free_map_init (struct mount *mnt) {
+	struct free_map *fm = calloc (1, sizeof *fm);
+
+	if (fm == NULL)
+		return false;
+	fm->mount_id = mnt->id;
+	lock_init (&fm->lock);
+	fm->map = bitmap_create (disk_size (mnt->disk));
+	if (fm->map == NULL)
+		goto fail;
+	bitmap_mark (fm->map, FREE_MAP_SECTOR);
+	bitmap_mark (fm->map, mount_disk_sector (ROOT_DIR_SECTOR));
+	if (fm->mount_id == 0)
+		bitmap_set_multiple (fm->map, journal_start (), JOURNAL_SECTORS, true);
+	fm->free_cnt = bitmap_count (fm->map, 0, bitmap_size (fm->map), false);
+
+	fm->dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (fm->map),
+				DISK_SECTOR_SIZE));
+	if (fm->dirty_map == NULL)
+		goto fail;
+	mnt->free_map = fm;
+	return true;
+
+fail:
+	if (fm->map != NULL)
+		bitmap_destroy (fm->map);
+	free (fm);
+	return false;
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
+/* Changes the bits of FM for the CNT sectors starting at SECTOR to
+ * VALUE.  The dirty-region log learns of the change first, since the
+ * free map file may be written at any time.
+ * Must be called with FM's lock held. */
+static void
+set_bits (struct free_map *fm, disk_sector_t sector, size_t cnt, bool value) {
+	journal_mark (mount_sector (fm->mount_id, sector), cnt);
+	bitmap_set_multiple (fm->map, sector, cnt, value);
+	mark_dirty (fm, sector, cnt);
+}
+
+/* Allocates CNT consecutive sectors from the free map of MNT and
+ * stores the first into *SECTORP.
  * Returns true if successful, false if all sectors were
  * available. */
 bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+free_map_allocate (struct mount *mnt, size_t cnt, disk_sector_t *sectorp) {
+	struct free_map *fm = mnt->free_map;
+	disk_sector_t sector = BITMAP_ERROR;
+
+	lock_acquire (&fm->lock);
+	/* Sectors reserved by others are not available. */
+	if (fm->free_cnt >= fm->reserved_cnt + cnt)
+		sector = bitmap_scan (fm->map, 0, cnt, false);
+	if (sector != BITMAP_ERROR) {
+		set_bits (fm, sector, cnt, true);
+		*sectorp = mount_sector (fm->mount_id, sector);
+		fm->free_cnt -= cnt;
 	}
-	if (sector != BITMAP_ERROR)
-		*sectorp = sector;
+	lock_release (&fm->lock);
 	return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates up to CNT consecutive free sectors starting exactly at
+ * SECTOR, stopping at the first sector in use.
+ * Returns the number of sectors allocated, possibly 0. */
+size_t
+free_map_allocate_after (disk_sector_t sector, size_t cnt) {
+	struct free_map *fm = mount_of (sector)->free_map;
+	size_t n = 0;
+
+	sector = mount_disk_sector (sector);
+	lock_acquire (&fm->lock);
+	if (cnt > fm->free_cnt - fm->reserved_cnt)
+		cnt = fm->free_cnt - fm->reserved_cnt;
+	while (n < cnt && sector + n < bitmap_size (fm->map)
+			&& !bitmap_test (fm->map, sector + n))
+		n++;
+	set_bits (fm, sector, n, true);
+	fm->free_cnt -= n;
+	lock_release (&fm->lock);
+	return n;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.  The
+ * journal learns of it first, since they may be reused for data
+ * at once. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
-	ASSERT (bitmap_all (free_map, sector, cnt));
-	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	struct free_map *fm = mount_of (sector)->free_map;
+
+	journal_revoke (sector, cnt);
+	sector = mount_disk_sector (sector);
+	lock_acquire (&fm->lock);
+	ASSERT (bitmap_all (fm->map, sector, cnt));
+	set_bits (fm, sector, cnt, false);
+	fm->free_cnt += cnt;
+	lock_release (&fm->lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Returns true if SECTOR is in use. */
+bool
+free_map_test (disk_sector_t sector) {
+	struct free_map *fm = mount_of (sector)->free_map;
+	bool used;
+
+	lock_acquire (&fm->lock);
+	used = bitmap_test (fm->map, mount_disk_sector (sector));
+	lock_release (&fm->lock);
+	return used;
+}
+
+/* Writes the free map sectors of MNT changed since the last sync
+ * to its free map file.  Allocations and releases only change the
+ * in-memory map, so this is what makes them persistent. */
 void
-free_map_open (void) {
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-	if (free_map_file == NULL)
-		PANIC ("can't open free map");
-	if (!bitmap_read (free_map, free_map_file))
-		PANIC ("can't read free map");
+free_map_sync (struct mount *mnt) {
+	struct free_map *fm = mnt->free_map;
+	size_t i;
+
+	if (fm == NULL || fm->file == NULL)
+		return;
+	journal_begin ();
+	for (i = 0; i < bitmap_size (fm->dirty_map); i++) {
+		bool dirty;
+
+		/* Writing the sector may allocate, so do it unlocked.  A
+		 * sector changed meanwhile is marked again. */
+		lock_acquire (&fm->lock);
+		dirty = take_dirty (fm, i);
+		lock_release (&fm->lock);
+
+		if (dirty && !bitmap_write_range (fm->map, fm->file,
+					i * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE))
+			PANIC ("can't write free map");
+	}
+	journal_end ();
+}
+
+/* Sets aside CNT free sectors of MNT, without choosing which, for
+ * data whose allocation is delayed.  Other allocations cannot use
+ * them until they are given back by free_map_unreserve().
+ * Returns false if fewer than CNT sectors are free. */
+bool
+free_map_reserve (struct mount *mnt, size_t cnt) {
+	struct free_map *fm = mnt->free_map;
+	bool success;
+
+	lock_acquire (&fm->lock);
+	success = fm->free_cnt >= fm->reserved_cnt + cnt;
+	if (success)
+		fm->reserved_cnt += cnt;
+	lock_release (&fm->lock);
+	return success;
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Gives back CNT sectors of MNT set aside by free_map_reserve(),
+ * usually right before allocating them. */
 void
-free_map_close (void) {
-	file_close (free_map_file);
+free_map_unreserve (struct mount *mnt, size_t cnt) {
+	struct free_map *fm = mnt->free_map;
+
+	lock_acquire (&fm->lock);
+	ASSERT (fm->reserved_cnt >= cnt);
+	fm->reserved_cnt -= cnt;
+	lock_release (&fm->lock);
+}
+
+/* Returns the number of free sectors of MNT. */
+size_t
+free_map_free_cnt (struct mount *mnt) {
+	return mnt->free_map->free_cnt;
 }
 
-/* Creates a new free map file on disk and writes the free map to
- * it. */
+/* Opens the free map file of MNT and reads it from disk.
+ * Returns false if the file cannot be read. */
+bool
+free_map_open (struct mount *mnt) {
+	struct free_map *fm = mnt->free_map;
+
+	fm->file = file_open (inode_open (mount_sector (fm->mount_id,
+					FREE_MAP_SECTOR)));
+	if (fm->file == NULL)
+		return false;
+	inode_set_metadata (file_get_inode (fm->file));
+	if (!bitmap_read (fm->map, fm->file)) {
+		file_close (fm->file);
+		fm->file = NULL;
+		return false;
+	}
+	fm->free_cnt = bitmap_count (fm->map, 0, bitmap_size (fm->map), false);
+	return true;
+}
+
+/* Writes the free map of MNT to disk and closes the free map
+ * file. */
+void
+free_map_close (struct mount *mnt) {
+	struct free_map *fm = mnt->free_map;
+
+	free_map_sync (mnt);
+	file_close (fm->file);
+	fm->file = NULL;
+}
+
+/* Frees the free map of MNT, which must be closed. */
 void
-free_map_create (void) {
+free_map_destroy (struct mount *mnt) {
+	struct free_map *fm = mnt->free_map;
+
+	ASSERT (fm->file == NULL);
+	bitmap_destroy (fm->map);
+	bitmap_destroy (fm->dirty_map);
+	free (fm);
+	mnt->free_map = NULL;
+}
+
+/* Creates a new free map file on the disk of MNT and writes the
+ * free map to it. */
+void
+free_map_create (struct mount *mnt) {
+	struct free_map *fm = mnt->free_map;
+	disk_sector_t sector = mount_sector (fm->mount_id, FREE_MAP_SECTOR);
+	size_t i;
+
 	/* Create inode. */
-	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+	if (!inode_create (sector, bitmap_file_size (fm->map)))
 		PANIC ("free map creation failed");
 
 	/* Write bitmap to file. */
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-	if (free_map_file == NULL)
+	fm->file = file_open (inode_open (sector));
+	if (fm->file == NULL)
 		PANIC ("can't open free map");
-	if (!bitmap_write (free_map, free_map_file))
+	inode_set_metadata (file_get_inode (fm->file));
+
+	/* The file's own sectors are only allocated while it is written,
+	 * which dirties their part of the map again. */
+	lock_acquire (&fm->lock);
+	for (i = 0; i < bitmap_size (fm->dirty_map); i++)
+		take_dirty (fm, i);
+	lock_release (&fm->lock);
+	if (!bitmap_write (fm->map, fm->file))
 		PANIC ("can't write free map");
 }
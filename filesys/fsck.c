@@ -0,0 +1,296 @@
+/* fsck.c: File system checker, run at boot after an unclean
+ * shutdown.
+ *
+ * FSCK_THREADS worker threads walk the directory tree together,
+ * taking directories to scan from a shared queue.  Each worker
+ * marks the sectors used by the inodes it visits in a bitmap of its
+ * own, so the walk needs no locking beyond the queue.  Afterwards
+ * the bitmaps are merged and compared with the free map, which is
+ * repaired to match.
+ *
+ * Only the regions that the dirty-region log (see journal.c) marks
+ * as changed since the last clean shutdown are compared.  The rest
+ * of the disk was consistent then and has not been touched.  The
+ * walk itself is not incremental: any file may own sectors in a
+ * dirty region, so every inode is still read, and only the
+ * comparison with the free map is limited to the dirty regions.
+ *
+ * A subtree that cannot be walked, for lack of memory or because
+ * its directory cannot be opened, leaves the sectors it uses
+ * unmarked.  If that happens, sectors the walk did not see are not
+ * released, since they may belong to the skipped files, and the
+ * regions stay dirty so that the next check looks at them again. */
+
+#include "filesys/fsck.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of entries a worker reads from a directory at a time. */
+#define FSCK_BATCH 32
+
+/* A directory waiting to be scanned. */
+struct fsck_dir {
+	struct list_elem elem;              /* Element in dir_queue. */
+	disk_sector_t sector;               /* Inode sector. */
+};
+
+/* A worker thread and what it found. */
+struct fsck_worker {
+	struct bitmap *used;                /* Sectors referenced. */
+	size_t inode_cnt;                   /* Inodes visited. */
+	size_t dup_cnt;                     /* Sectors referenced twice. */
+	size_t bad_cnt;                     /* Entries without a valid inode. */
+	size_t skip_cnt;                    /* Subtrees that went unchecked. */
+	struct semaphore done;              /* Up'd when the worker exits. */
+};
+
+/* State shared by the workers, protected by fsck_lock. */
+static struct list dir_queue;           /* Directories to scan. */
+static int busy_cnt;                    /* Workers scanning a directory. */
+static struct bitmap *inodes;           /* Inode sectors visited. */
+static struct lock fsck_lock;
+static struct condition dir_queued;     /* Signaled on new work or the end. */
+
+/* Marks the CNT sectors starting at START as used by worker AUX. */
+static void
+mark_run (disk_sector_t start, size_t cnt, void *w_) {
+	struct fsck_worker *w = w_;
+	size_t size = bitmap_size (w->used);
+
+	if (start >= size || cnt > size - start) {
+		w->bad_cnt++;
+		return;
+	}
+	if (bitmap_any (w->used, start, cnt))
+		w->dup_cnt++;
+	bitmap_set_multiple (w->used, start, cnt, true);
+}
+
+/* Queues directory SECTOR to be scanned. */
+static void
+queue_dir (struct fsck_worker *w, disk_sector_t sector) {
+	struct fsck_dir *d = malloc (sizeof *d);
+
+	if (d == NULL) {
+		/* Its subtree goes unchecked. */
+		w->skip_cnt++;
+		return;
+	}
+	d->sector = sector;
+	lock_acquire (&fsck_lock);
+	list_push_back (&dir_queue, &d->elem);
+	cond_signal (&dir_queued, &fsck_lock);
+	lock_release (&fsck_lock);
+}
+
+/* Visits the inode in SECTOR, marking its sectors as used by W, and
+ * queues it to be scanned if IS_DIR is true.  An inode already
+ * visited, through another entry, is not visited again, so that a
+ * damaged tree cannot make the walk loop. */
+static void
+check_inode (struct fsck_worker *w, disk_sector_t sector, bool is_dir) {
+	struct inode *inode;
+	bool seen;
+
+	if (sector >= bitmap_size (inodes)) {
+		w->bad_cnt++;
+		return;
+	}
+	lock_acquire (&fsck_lock);
+	seen = bitmap_test (inodes, sector);
+	bitmap_mark (inodes, sector);
+	lock_release (&fsck_lock);
+	if (seen) {
+		w->dup_cnt++;
+		return;
+	}
+
+	mark_run (sector, 1, w);
+	if (!inode_valid (sector)) {
+		w->bad_cnt++;
+		return;
+	}
+	inode = inode_open (sector);
+	if (inode == NULL) {
+		w->skip_cnt++;
+		return;
+	}
+	w->inode_cnt++;
+	inode_map_runs (inode, mark_run, w);
+	inode_close (inode);
+	if (is_dir)
+		queue_dir (w, sector);
+}
+
+/* Visits the inode of every entry of directory SECTOR. */
+static void
+scan_dir (struct fsck_worker *w, disk_sector_t sector,
+		struct dirent *ents) {
+	struct dir *dir = dir_open (inode_open (sector));
+	size_t cnt, i;
+
+	if (dir == NULL) {
+		w->skip_cnt++;
+		return;
+	}
+	while ((cnt = dir_readdir_batch (dir, ents, FSCK_BATCH)) > 0)
+		for (i = 0; i < cnt; i++)
+			check_inode (w, ents[i].d_ino, ents[i].d_type == DT_DIR);
+	dir_close (dir);
+}
+
+/* Scans queued directories until every directory has been
+ * scanned. */
+static void
+fsck_worker (void *w_) {
+	struct fsck_worker *w = w_;
+	struct dirent *ents = malloc (FSCK_BATCH * sizeof *ents);
+
+	for (;;) {
+		struct fsck_dir *d;
+
+		lock_acquire (&fsck_lock);
+		while (list_empty (&dir_queue) && busy_cnt > 0)
+			cond_wait (&dir_queued, &fsck_lock);
+		if (list_empty (&dir_queue)) {
+			/* Nobody is scanning, so nothing more can be queued. */
+			cond_broadcast (&dir_queued, &fsck_lock);
+			lock_release (&fsck_lock);
+			break;
+		}
+		d = list_entry (list_pop_front (&dir_queue), struct fsck_dir, elem);
+		busy_cnt++;
+		lock_release (&fsck_lock);
+
+		if (ents != NULL)
+			scan_dir (w, d->sector, ents);
+		else
+			w->skip_cnt++;
+		free (d);
+
+		lock_acquire (&fsck_lock);
+		if (--busy_cnt == 0)
+			cond_broadcast (&dir_queued, &fsck_lock);
+		lock_release (&fsck_lock);
+	}
+	free (ents);
+	sema_up (&w->done);
+}
+
+/* Checks the root file system against the free map after an
+ * unclean shutdown and repairs the free map: sectors in use but
+ * marked free are allocated, and sectors marked in use but not
+ * used by any file are released, unless part of the tree could
+ * not be walked.  Sectors used by two files are only reported.
+ * Does nothing if the file system was shut down cleanly.  Must run
+ * before anything else uses the file system. */
+void
+fsck_run (void) {
+	struct fsck_worker workers[FSCK_THREADS];
+	disk_sector_t end = journal_start ();
+	disk_sector_t region = journal_region_sectors ();
+	size_t inode_cnt = 0, dup_cnt = 0, bad_cnt = 0, skip_cnt = 0;
+	size_t lost_cnt = 0, leaked_cnt = 0, region_cnt = 0;
+	int64_t start = timer_ticks ();
+	disk_sector_t first, sector;
+	int i;
+
+	if (journal_was_clean ())
+		return;
+	printf ("Checking file system...\n");
+
+	list_init (&dir_queue);
+	busy_cnt = 0;
+	lock_init (&fsck_lock);
+	cond_init (&dir_queued);
+	inodes = bitmap_create (end);
+	if (inodes == NULL)
+		PANIC ("fsck: out of memory");
+	for (i = 0; i < FSCK_THREADS; i++) {
+		struct fsck_worker *w = &workers[i];
+
+		w->used = bitmap_create (end);
+		if (w->used == NULL)
+			PANIC ("fsck: out of memory");
+		w->inode_cnt = w->dup_cnt = w->bad_cnt = w->skip_cnt = 0;
+		sema_init (&w->done, 0);
+	}
+
+	/* The walk starts from the inodes that no directory holds. */
+	check_inode (&workers[0], FREE_MAP_SECTOR, false);
+	check_inode (&workers[0], ROOT_DIR_SECTOR, true);
+	for (i = 0; i < FSCK_THREADS; i++) {
+		char name[16];
+
+		snprintf (name, sizeof name, "fsck%d", i);
+		if (thread_create (name, PRI_DEFAULT, fsck_worker, &workers[i])
+				== TID_ERROR)
+			PANIC ("fsck: thread creation failed");
+	}
+	for (i = 0; i < FSCK_THREADS; i++) {
+		sema_down (&workers[i].done);
+		inode_cnt += workers[i].inode_cnt;
+		dup_cnt += workers[i].dup_cnt;
+		bad_cnt += workers[i].bad_cnt;
+		skip_cnt += workers[i].skip_cnt;
+	}
+	if (skip_cnt > 0)
+		printf ("fsck: %zu subtrees unchecked, not releasing sectors\n",
+				skip_cnt);
+
+	/* Reconcile the workers' findings with the free map, one dirty
+	 * region at a time, each a journal operation of its own. */
+	for (first = 0; first < end; first += region) {
+		if (!journal_region_dirty (first))
+			continue;
+		region_cnt++;
+		journal_begin ();
+		for (sector = first; sector < first + region && sector < end;
+				sector++) {
+			int refs = 0;
+
+			for (i = 0; i < FSCK_THREADS; i++)
+				refs += bitmap_test (workers[i].used, sector);
+			if (refs > 1)
+				dup_cnt++;
+			if (refs > 0 && !free_map_test (sector)) {
+				free_map_allocate_after (sector, 1);
+				lost_cnt++;
+			} else if (refs == 0 && free_map_test (sector) && skip_cnt == 0) {
+				free_map_release (sector, 1);
+				leaked_cnt++;
+			}
+		}
+		journal_end ();
+	}
+
+	/* Make the repairs durable before forgetting the regions.  After
+	 * an incomplete walk, keep them for the next check. */
+	journal_commit ();
+	if (skip_cnt == 0)
+		journal_regions_clear ();
+
+	for (i = 0; i < FSCK_THREADS; i++)
+		bitmap_destroy (workers[i].used);
+	bitmap_destroy (inodes);
+
+	printf ("fsck: %zu inodes, %zu of %zu regions checked in %"PRId64
+			" ticks: %zu sectors lost, %zu leaked, %zu shared, "
+			"%zu bad entries.\n",
+			inode_cnt, region_cnt, (size_t) DIV_ROUND_UP (end, region),
+			timer_ticks () - start, lost_cnt, leaked_cnt, dup_cnt, bad_cnt);
+}
@@ -1,5 +1,7 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <dirent.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,18 +13,26 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Sectors moved to or from the scratch disk per transfer. */
+#define TRANSFER_SECTORS 64
+#define TRANSFER_PAGES (TRANSFER_SECTORS * DISK_SECTOR_SIZE / PGSIZE)
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) {
+	struct dirent ents[16];
 	struct dir *dir;
-	char name[NAME_MAX + 1];
+	size_t cnt, i;
 
 	printf ("Files in the root directory:\n");
 	dir = dir_open_root ();
 	if (dir == NULL)
 		PANIC ("root dir open failed");
-	while (dir_readdir (dir, name))
-		printf ("%s\n", name);
+	while ((cnt = dir_readdir_batch (dir, ents,
+					sizeof ents / sizeof *ents)) > 0)
+		for (i = 0; i < cnt; i++)
+			printf ("%s\n", ents[i].d_name);
+	dir_close (dir);
 	printf ("End of listing.\n");
 }
 
@@ -62,6 +72,24 @@ fsutil_rm (char **argv) {
 		PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Makes an empty file system on disk ARGV[1], given as CHAN:DEV,
+ * so that user programs can mount it. */
+void
+fsutil_mkfs (char **argv) {
+	const char *disk_name = argv[1];
+	const char *colon = strchr (disk_name, ':');
+	int chan, dev;
+
+	if (colon == NULL)
+		PANIC ("%s: disk must be given as CHAN:DEV", disk_name);
+	chan = atoi (disk_name);
+	dev = atoi (colon + 1);
+
+	printf ("Making a file system on hd%d:%d...\n", chan, dev);
+	if (!filesys_mkfs (chan, dev))
+		PANIC ("hd%d:%d: file system creation failed", chan, dev);
+}
+
 /* Copies from the "scratch" disk, hdc or hd1:0 to file ARGV[1]
  * in the file system.
  *
@@ -87,7 +115,7 @@ fsutil_put (char **argv) {
 	printf ("Putting '%s' into the file system...\n", file_name);
 
 	/* Allocate buffer. */
-	buffer = malloc (DISK_SECTOR_SIZE);
+	buffer = palloc_get_multiple (0, TRANSFER_PAGES);
 	if (buffer == NULL)
 		PANIC ("couldn't allocate buffer");
 
@@ -111,10 +139,21 @@ fsutil_put (char **argv) {
 	if (dst == NULL)
 		PANIC ("%s: open failed", file_name);
 
+	/* Lay the file out contiguously.  If the disk is too full for
+	 * that, the copy still uses whatever space there is. */
+	file_preallocate (dst, size);
+
 	/* Do copy. */
 	while (size > 0) {
-		int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-		disk_read (src, sector++, buffer);
+		size_t sector_cnt = DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+		int chunk_size;
+
+		if (sector_cnt > TRANSFER_SECTORS)
+			sector_cnt = TRANSFER_SECTORS;
+		chunk_size = size < (off_t) (sector_cnt * DISK_SECTOR_SIZE)
+			? size : (off_t) (sector_cnt * DISK_SECTOR_SIZE);
+		disk_read_multiple (src, sector, buffer, sector_cnt);
+		sector += sector_cnt;
 		if (file_write (dst, buffer, chunk_size) != chunk_size)
 			PANIC ("%s: write failed with %"PROTd" bytes unwritten",
 					file_name, size);
@@ -123,7 +162,7 @@ fsutil_put (char **argv) {
 
 	/* Finish up. */
 	file_close (dst);
-	free (buffer);
+	palloc_free_multiple (buffer, TRANSFER_PAGES);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch disk.
@@ -150,7 +189,7 @@ fsutil_get (char **argv) {
 	printf ("Getting '%s' from the file system...\n", file_name);
 
 	/* Allocate buffer. */
-	buffer = malloc (DISK_SECTOR_SIZE);
+	buffer = palloc_get_multiple (0, TRANSFER_PAGES);
 	if (buffer == NULL)
 		PANIC ("couldn't allocate buffer");
 
@@ -173,17 +212,25 @@ fsutil_get (char **argv) {
 
 	/* Do copy. */
 	while (size > 0) {
-		int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-		if (sector >= disk_size (dst))
+		size_t sector_cnt = DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+		int chunk_size;
+
+		if (sector_cnt > TRANSFER_SECTORS)
+			sector_cnt = TRANSFER_SECTORS;
+		chunk_size = size < (off_t) (sector_cnt * DISK_SECTOR_SIZE)
+			? size : (off_t) (sector_cnt * DISK_SECTOR_SIZE);
+		if (sector + sector_cnt > disk_size (dst))
 			PANIC ("%s: out of space on scratch disk", file_name);
 		if (file_read (src, buffer, chunk_size) != chunk_size)
 			PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-		memset (buffer + chunk_size, 0, DISK_SECTOR_SIZE - chunk_size);
-		disk_write (dst, sector++, buffer);
+		memset (buffer + chunk_size, 0,
+				sector_cnt * DISK_SECTOR_SIZE - chunk_size);
+		disk_write_multiple (dst, sector, buffer, sector_cnt);
+		sector += sector_cnt;
 		size -= chunk_size;
 	}
 
 	/* Finish up. */
 	file_close (src);
-	free (buffer);
+	palloc_free_multiple (buffer, TRANSFER_PAGES);
 }
@@ -1,24 +1,101 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/mount.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-/* On-disk inode.
+/* Inode flags. */
+#define INODE_INLINE 0x1                /* Data is in the inode sector. */
+
+#ifdef EFILESYS
+/* Bytes of data an inode sector holds for an inline file. */
+#define INODE_INLINE_MAX 496
+
+/* On-disk inode.  The data lives in the FAT cluster chain that
+ * starts at START, or in INLINE_DATA if FLAGS has INODE_INLINE.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct inode_disk {
+	cluster_t start;                    /* First data cluster, or 0. */
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t flags;                     /* INODE_* flags. */
+	uint8_t inline_data[INODE_INLINE_MAX];  /* Data of an inline file. */
+};
+#else
+/* A run of contiguous data sectors. */
+struct extent {
+	uint32_t file_sector;               /* First file sector covered. */
+	disk_sector_t start;                /* First disk sector. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+/* Number of extents stored in the inode itself. */
+#define INLINE_EXTENTS 40
+
+/* Number of extents stored in each overflow extent block. */
+#define BLOCK_EXTENTS 42
+
+/* Bytes of data an inode sector holds for an inline file, in
+ * place of its extents. */
+#define INODE_INLINE_MAX (INLINE_EXTENTS * sizeof (struct extent))
+
+/* On-disk inode.  An inline file, with INODE_INLINE in FLAGS, has
+ * no extents and keeps its data in INLINE_DATA instead.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents in total. */
+	disk_sector_t overflow;             /* First overflow block, or 0. */
+	union {
+		struct extent extents[INLINE_EXTENTS];  /* First extents. */
+		uint8_t inline_data[INODE_INLINE_MAX];  /* Data of an inline file. */
+	};
+	uint32_t flags;                     /* INODE_* flags. */
+	uint32_t unused[3];                 /* Not used. */
 };
 
+/* On-disk overflow block, holding the extents that do not fit in
+ * the inode.  Blocks are chained through NEXT.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	disk_sector_t next;                 /* Next overflow block, or 0. */
+	uint32_t extent_cnt;                /* Extents used in this block. */
+	struct extent extents[BLOCK_EXTENTS];   /* Following extents. */
+};
+
+/* A file sector written where the file has no disk space yet: past
+ * its last allocated sector, or in a hole.  The sector's disk space
+ * is only allocated when the inode's pending sectors are written
+ * back, so that growing a file allocates long runs at once and
+ * never writes zeros. */
+struct pending_sector {
+	struct list_elem elem;              /* Element in inode's PENDING. */
+	uint32_t file_sector;               /* File sector held. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+};
+
+/* Pending sectors an inode holds before writing them back. */
+#define PENDING_MAX 64
+
+/* Sectors whose free map bits share one free map sector. */
+#define MAP_SECTOR_BITS (DISK_SECTOR_SIZE * 8)
+#endif
+
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
 static inline size_t
@@ -28,35 +105,984 @@ bytes_to_sectors (off_t size) {
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open inode table. */
 	disk_sector_t sector;               /* Sector number of disk location. */
-	int open_cnt;                       /* Number of openers. */
+	int open_cnt;                       /* Number of openers, protected
+	                                       by its open_inodes stripe. */
+	bool closing;                       /* Last opener is closing it,
+	                                       protected by the stripe. */
+	bool loading;                       /* First opener is reading it,
+	                                       protected by the stripe. */
 	bool removed;                       /* True if deleted, false otherwise. */
+	bool metadata;                      /* Holds file system metadata? */
+	struct rwlock rw;                   /* Readers share DATA, the data map
+	                                       and the pending sectors; a
+	                                       writer owns them. */
+	struct lock dir_lock;               /* Serializes directory
+	                                       operations. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+	struct list_elem batch_elem;        /* Element in an inode_flush()
+	                                       batch or in DOOMED. */
+
+#ifdef EFILESYS
+	struct fat_chain chain;             /* Index of the data clusters. */
+	struct lock chain_lock;             /* Protects CHAIN, which lookups
+	                                       update with RW held only for
+	                                       reading. */
+#else
+	/* All DATA.EXTENT_CNT extents, sorted by file sector, so that
+	 * mapping an offset never reads an overflow block. */
+	struct extent *extents;
+	size_t extent_cap;                  /* Capacity of EXTENTS. */
+	disk_sector_t *blocks;              /* Overflow block sectors. */
+	size_t block_cnt;                   /* Number of overflow blocks. */
+
+	/* Written sectors without disk space, each holding one free
+	 * sector reserved in the free map. */
+	struct list pending;
+	size_t pending_cnt;                 /* Number of PENDING sectors. */
+
+	/* Disk sectors set aside by inode_preallocate(), already taken
+	 * from the free map.  File sector PREALLOC_FILE_SECTOR + I gets
+	 * disk sector PREALLOC_START + I once it is written. */
+	uint32_t prealloc_file_sector;
+	disk_sector_t prealloc_start;
+	size_t prealloc_cnt;                /* 0 if none are set aside. */
+#endif
 };
 
+/* Writes SIZE bytes from BUFFER into data SECTOR of INODE at
+ * SECTOR_OFS, logging them in the journal if INODE holds file
+ * system metadata. */
+static void
+data_write (struct inode *inode, disk_sector_t sector, const void *buffer,
+		int sector_ofs, int size) {
+	if (inode->metadata)
+		buffer_cache_write_meta (sector, buffer, sector_ofs, size);
+	else
+		buffer_cache_write (sector, buffer, sector_ofs, size);
+}
+
+/* Sets aside CNT log sectors in the running journal operation for
+ * changes to INODE's file system, of which only the root has a
+ * journal.  Returns false if the transaction has no room left. */
+static bool
+reserve_log (const struct inode *inode, size_t cnt) {
+	return mount_id (inode->sector) != 0 || journal_reserve (cnt);
+}
+
+#ifdef EFILESYS
+/* Returns the number of file sectors INODE has disk space for. */
+static size_t
+allocated_sectors (struct inode *inode) {
+	size_t cnt;
+
+	lock_acquire (&inode->chain_lock);
+	cnt = fat_chain_length (&inode->chain) * SECTORS_PER_CLUSTER;
+	lock_release (&inode->chain_lock);
+	return cnt;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE.
+ * Returns -1 if INODE does not contain data for a byte at offset
+ * POS. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos) {
+	size_t sector = pos / DISK_SECTOR_SIZE;
+	cluster_t clst;
+
+	ASSERT (inode != NULL);
+	if (pos >= inode->data.length)
+		return -1;
+
+	lock_acquire (&inode->chain_lock);
+	clst = fat_chain_seek (&inode->chain, sector / SECTORS_PER_CLUSTER);
+	lock_release (&inode->chain_lock);
+	if (clst == 0)
+		return -1;
+	return cluster_to_sector (clst) + sector % SECTORS_PER_CLUSTER;
+}
+
+/* Sets up the index of INODE's cluster chain. */
+static bool
+map_load (struct inode *inode) {
+	lock_init (&inode->chain_lock);
+	fat_chain_init (&inode->chain, inode->data.start);
+	return true;
+}
+
+/* Writes INODE's header back to disk. */
+static void
+map_store (struct inode *inode) {
+	inode->data.start = inode->chain.start;
+	buffer_cache_write_meta (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+
+/* Releases the data clusters of INODE from the start of the file
+ * on, for as long as the running journal transaction has room for
+ * the change.  Returns true if all are released. */
+static bool
+map_release (struct inode *inode) {
+	bool done;
+
+	lock_acquire (&inode->chain_lock);
+	done = fat_chain_release (&inode->chain);
+	lock_release (&inode->chain_lock);
+	return done;
+}
+
+/* Frees the memory used to map INODE's data. */
+static void
+map_free (struct inode *inode) {
+	fat_chain_destroy (&inode->chain);
+}
+
+/* Calls FN for each run of disk sectors that INODE's data uses. */
+static void
+map_runs (struct inode *inode, inode_run_func *fn, void *aux) {
+	cluster_t clst;
+	size_t i;
+
+	lock_acquire (&inode->chain_lock);
+	for (i = 0; (clst = fat_chain_seek (&inode->chain, i)) != 0; i++)
+		fn (cluster_to_sector (clst), SECTORS_PER_CLUSTER, aux);
+	lock_release (&inode->chain_lock);
+}
+
+/* Returns true if DISK_INODE has a plausible cluster chain. */
+static bool
+map_valid (const struct inode_disk *disk_inode UNUSED) {
+	return true;
+}
+
+/* Grows INODE to LENGTH bytes, appending and zeroing clusters, and
+ * writes the inode back.
+ * Returns false if the disk is full, memory allocation fails or
+ * the running journal transaction has no room for more clusters. */
+static bool
+inode_allocate (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t have = allocated_sectors (inode);
+	size_t want = bytes_to_sectors (length);
+	bool success = true;
+
+	while (have < want) {
+		disk_sector_t sector;
+		cluster_t clst;
+		size_t i;
+
+		lock_acquire (&inode->chain_lock);
+		clst = fat_chain_extend (&inode->chain);
+		lock_release (&inode->chain_lock);
+		if (clst == 0) {
+			success = false;
+			break;
+		}
+		sector = cluster_to_sector (clst);
+		for (i = 0; i < SECTORS_PER_CLUSTER; i++, have++)
+			buffer_cache_write (sector + i, zeros, 0, DISK_SECTOR_SIZE);
+	}
+
+	/* On failure, keep whatever prefix could be allocated. */
+	if (length > (off_t) (have * DISK_SECTOR_SIZE))
+		length = have * DISK_SECTOR_SIZE;
+	if (length > inode->data.length)
+		inode->data.length = length;
+	map_store (inode);
+	return success;
+}
+
+/* Grows INODE to LENGTH bytes for a write past end of file.
+ * FAT clusters are allocated right away. */
+static bool
+inode_extend (struct inode *inode, off_t length) {
+	return inode_allocate (inode, length);
+}
+
+/* Every sector up to the end of file already has a cluster, taken
+ * from the FAT allocator's contiguous free runs. */
+static bool
+map_preallocate (struct inode *inode UNUSED) {
+	return true;
+}
+
+/* Nothing is ever set aside. */
+static void
+prealloc_release (struct inode *inode UNUSED) {
+}
+
+/* Clusters are never delayed, so there is nothing to write back. */
+static bool
+pending_writeback (struct inode *inode UNUSED) {
+	return true;
+}
+
+/* Clusters are never delayed, so there is nothing to write back. */
+static bool
+pending_flush (struct inode *inode UNUSED) {
+	return true;
+}
+
+/* Clusters are never delayed, so there is nothing to discard. */
+static void
+pending_discard (struct inode *inode UNUSED) {
+}
+
+/* Every FAT file sector has a cluster. */
+static void
+unmapped_read (struct inode *inode UNUSED, uint32_t file_sector UNUSED,
+		void *buffer UNUSED, int sector_ofs UNUSED, int size UNUSED) {
+	NOT_REACHED ();
+}
+
+/* Every FAT file sector has a cluster. */
+static bool
+unmapped_write (struct inode *inode UNUSED, uint32_t file_sector UNUSED,
+		const void *buffer UNUSED, int sector_ofs UNUSED, int size UNUSED) {
+	NOT_REACHED ();
+}
+#else
+
+/* Returns the extent of INODE that covers FILE_SECTOR, or a null
+ * pointer if none does.  Binary search over the extents. */
+static const struct extent *
+extent_lookup (const struct inode *inode, uint32_t file_sector) {
+	size_t lo = 0, hi = inode->data.extent_cnt;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct extent *e = &inode->extents[mid];
+
+		if (file_sector < e->file_sector)
+			hi = mid;
+		else if (file_sector >= e->file_sector + e->length)
+			lo = mid + 1;
+		else
+			return e;
+	}
+	return NULL;
+}
+
+/* Returns the number of file sectors up to the end of INODE's last
+ * extent.  Holes before it have no disk space. */
+static size_t
+allocated_sectors (const struct inode *inode) {
+	const struct extent *last;
+
+	if (inode->data.extent_cnt == 0)
+		return 0;
+	last = &inode->extents[inode->data.extent_cnt - 1];
+	return last->file_sector + last->length;
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) {
+	const struct extent *e;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
 		return -1;
+
+	e = extent_lookup (inode, pos / DISK_SECTOR_SIZE);
+	if (e == NULL)
+		return -1;
+	return e->start + (pos / DISK_SECTOR_SIZE - e->file_sector);
+}
+
+/* Moves the CNT extents at SRC to DST, making their start sectors
+ * sectors of mount ID.  Extents on disk hold sectors of mount 0,
+ * that is, plain disk sectors. */
+static void
+extents_copy (struct extent *dst, const struct extent *src, size_t cnt,
+		int id) {
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		dst[i] = src[i];
+		dst[i].start = mount_sector (id, mount_disk_sector (src[i].start));
+	}
+}
+
+/* Returns SECTOR, a sector of INODE's disk, as a sector of INODE's
+ * mount, or 0 if it is 0. */
+static disk_sector_t
+block_sector (const struct inode *inode, disk_sector_t sector) {
+	return sector != 0 ? mount_sector (mount_id (inode->sector), sector) : 0;
+}
+
+/* Reads INODE's overflow blocks into INODE->extents.
+ * Returns false if memory allocation fails. */
+static bool
+map_load (struct inode *inode) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t inline_cnt = cnt < INLINE_EXTENTS ? cnt : INLINE_EXTENTS;
+	disk_sector_t block = block_sector (inode, inode->data.overflow);
+	struct extent_block *eb = NULL;
+	size_t loaded;
+
+	inode->extent_cap = cnt > 8 ? cnt : 8;
+	inode->extents = malloc (inode->extent_cap * sizeof *inode->extents);
+	list_init (&inode->pending);
+	inode->pending_cnt = 0;
+	inode->prealloc_cnt = 0;
+	inode->block_cnt = DIV_ROUND_UP (cnt - inline_cnt, BLOCK_EXTENTS);
+	inode->blocks = malloc ((inode->block_cnt + 1) * sizeof *inode->blocks);
+	if (inode->extents == NULL || inode->blocks == NULL)
+		goto fail;
+	extents_copy (inode->extents, inode->data.extents, inline_cnt,
+			mount_id (inode->sector));
+
+	if (inode->block_cnt > 0) {
+		eb = malloc (sizeof *eb);
+		if (eb == NULL)
+			goto fail;
+	}
+	for (loaded = 0; loaded < inode->block_cnt; loaded++) {
+		if (block == 0) {
+			/* The chain is shorter than the extent count says. */
+			free (eb);
+			goto fail;
+		}
+		inode->blocks[loaded] = block;
+		buffer_cache_read (block, eb, 0, DISK_SECTOR_SIZE);
+		extents_copy (inode->extents + INLINE_EXTENTS + loaded * BLOCK_EXTENTS,
+				eb->extents, eb->extent_cnt, mount_id (inode->sector));
+		block = block_sector (inode, eb->next);
+	}
+	free (eb);
+	return true;
+
+fail:
+	free (inode->extents);
+	free (inode->blocks);
+	return false;
+}
+
+/* Writes INODE's header and every overflow block holding extent
+ * FIRST or a later one back to disk, along with the block before
+ * those, whose link to them may have changed. */
+static void
+extents_store (struct inode *inode, size_t first) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t i, first_block;
+
+	extents_copy (inode->data.extents, inode->extents,
+			cnt < INLINE_EXTENTS ? cnt : INLINE_EXTENTS, 0);
+	inode->data.overflow = inode->block_cnt > 0
+		? mount_disk_sector (inode->blocks[0]) : 0;
+	buffer_cache_write_meta (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+
+	first_block = first < INLINE_EXTENTS ? 0
+		: (first - INLINE_EXTENTS) / BLOCK_EXTENTS;
+	for (i = first_block > 0 ? first_block - 1 : 0; i < inode->block_cnt;
+			i++) {
+		struct extent_block eb;
+		size_t base = INLINE_EXTENTS + i * BLOCK_EXTENTS;
+
+		memset (&eb, 0, sizeof eb);
+		eb.next = i + 1 < inode->block_cnt
+			? mount_disk_sector (inode->blocks[i + 1]) : 0;
+		eb.extent_cnt = cnt - base < BLOCK_EXTENTS ? cnt - base : BLOCK_EXTENTS;
+		extents_copy (eb.extents, inode->extents + base, eb.extent_cnt, 0);
+		buffer_cache_write_meta (inode->blocks[i], &eb, 0, DISK_SECTOR_SIZE);
+	}
+}
+
+/* Returns the index of the first extent of INODE that starts at
+ * or after FILE_SECTOR. */
+static size_t
+extent_index (const struct inode *inode, uint32_t file_sector) {
+	size_t lo = 0, hi = inode->data.extent_cnt;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (inode->extents[mid].file_sector < file_sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Maps the LENGTH file sectors of INODE starting at FILE_SECTOR,
+ * which must be unmapped, to the disk sectors starting at START.
+ * The run is merged into a neighboring extent when it continues it
+ * both in the file and on disk.  Stores the index of the first
+ * extent changed into *FIRSTP.  Does not write anything to disk.
+ * Returns false if memory or an overflow block is unavailable. */
+static bool
+extent_insert (struct inode *inode, uint32_t file_sector,
+		disk_sector_t start, uint32_t length, size_t *firstp) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t i = extent_index (inode, file_sector);
+	struct extent *prev = i > 0 ? &inode->extents[i - 1] : NULL;
+	struct extent *next = i < cnt ? &inode->extents[i] : NULL;
+	bool join_prev = prev != NULL
+		&& prev->file_sector + prev->length == file_sector
+		&& prev->start + prev->length == start;
+	bool join_next = next != NULL
+		&& file_sector + length == next->file_sector
+		&& start + length == next->start;
+
+	if (join_prev && join_next) {
+		/* The run fills the hole between PREV and NEXT exactly. */
+		prev->length += length + next->length;
+		memmove (next, next + 1, (cnt - i - 1) * sizeof *next);
+		inode->data.extent_cnt--;
+		if (cnt - 1 >= INLINE_EXTENTS
+				&& (cnt - 1 - INLINE_EXTENTS) % BLOCK_EXTENTS == 0
+				&& inode->block_cnt > (cnt - 1 - INLINE_EXTENTS) / BLOCK_EXTENTS)
+			free_map_release (inode->blocks[--inode->block_cnt], 1);
+		*firstp = i - 1;
+		return true;
+	}
+	if (join_prev) {
+		prev->length += length;
+		*firstp = i - 1;
+		return true;
+	}
+	if (join_next) {
+		next->file_sector = file_sector;
+		next->start = start;
+		next->length += length;
+		*firstp = i;
+		return true;
+	}
+
+	if (cnt == inode->extent_cap) {
+		struct extent *extents = realloc (inode->extents,
+				2 * inode->extent_cap * sizeof *extents);
+		if (extents == NULL)
+			return false;
+		inode->extents = extents;
+		inode->extent_cap *= 2;
+	}
+	if (cnt >= INLINE_EXTENTS && (cnt - INLINE_EXTENTS) % BLOCK_EXTENTS == 0) {
+		/* Every overflow block is full: chain a new one. */
+		disk_sector_t *blocks = realloc (inode->blocks,
+				(inode->block_cnt + 1) * sizeof *blocks);
+		if (blocks == NULL)
+			return false;
+		inode->blocks = blocks;
+		if (!free_map_allocate (mount_of (inode->sector), 1,
+					&inode->blocks[inode->block_cnt]))
+			return false;
+		inode->block_cnt++;
+	}
+
+	memmove (&inode->extents[i + 1], &inode->extents[i],
+			(cnt - i) * sizeof *inode->extents);
+	inode->extents[i].file_sector = file_sector;
+	inode->extents[i].start = start;
+	inode->extents[i].length = length;
+	inode->data.extent_cnt++;
+	*firstp = i;
+	return true;
+}
+
+/* Writes INODE's header and extents back to disk. */
+static void
+map_store (struct inode *inode) {
+	extents_store (inode, 0);
+}
+
+/* Releases the data sectors and then the overflow blocks of INODE
+ * from the end of the file on, for as long as the running journal
+ * transaction has room for the free map sectors this changes.
+ * Returns true if all are released. */
+static bool
+map_release (struct inode *inode) {
+	while (inode->data.extent_cnt > 0) {
+		struct extent *e = &inode->extents[inode->data.extent_cnt - 1];
+		uint32_t cnt = e->length < MAP_SECTOR_BITS ? e->length : MAP_SECTOR_BITS;
+
+		if (!reserve_log (inode, 2))
+			return false;
+		e->length -= cnt;
+		free_map_release (e->start + e->length, cnt);
+		if (e->length == 0)
+			inode->data.extent_cnt--;
+	}
+	while (inode->block_cnt > 0) {
+		if (!reserve_log (inode, 1))
+			return false;
+		free_map_release (inode->blocks[--inode->block_cnt], 1);
+	}
+	return true;
+}
+
+/* Frees the memory used to map INODE's data. */
+static void
+map_free (struct inode *inode) {
+	free (inode->extents);
+	free (inode->blocks);
+}
+
+/* Calls FN for each run of disk sectors that INODE's data and
+ * overflow blocks use. */
+static void
+map_runs (struct inode *inode, inode_run_func *fn, void *aux) {
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++)
+		fn (inode->extents[i].start, inode->extents[i].length, aux);
+	for (i = 0; i < inode->block_cnt; i++)
+		fn (inode->blocks[i], 1, aux);
+}
+
+/* Returns true if DISK_INODE has a plausible extent map, one that
+ * map_load() can read. */
+static bool
+map_valid (const struct inode_disk *disk_inode) {
+	if (disk_inode->flags & INODE_INLINE)
+		return disk_inode->length <= (off_t) INODE_INLINE_MAX;
+	return disk_inode->extent_cnt <= INLINE_EXTENTS
+		|| disk_inode->overflow != 0;
+}
+
+/* Grows INODE to LENGTH bytes, for a write past end of file or a
+ * new file's initial size.  No disk space is allocated here: the
+ * new sectors are a hole that reads as zeros, and those that get
+ * written become pending sectors. */
+static bool
+inode_extend (struct inode *inode, off_t length) {
+	if (length > inode->data.length) {
+		inode->data.length = length;
+		buffer_cache_write_meta (inode->sector, &inode->data, 0,
+				DISK_SECTOR_SIZE);
+	}
+	return true;
+}
+
+/* Sets aside one run of free sectors for the file sectors of INODE
+ * from the end of its last extent to its end of file, or for as
+ * long a prefix of them as the free map has a run for.  Does
+ * nothing if INODE already has sectors set aside.
+ * Returns false if the disk is full. */
+static bool
+map_preallocate (struct inode *inode) {
+	size_t first = allocated_sectors (inode);
+	disk_sector_t start;
+	size_t cnt;
+
+	cnt = bytes_to_sectors (inode->data.length);
+	if (inode->prealloc_cnt > 0 || cnt <= first)
+		return true;
+
+	for (cnt -= first; cnt > 0; cnt /= 2)
+		if (free_map_allocate (mount_of (inode->sector), cnt, &start))
+			break;
+	if (cnt == 0)
+		return false;
+	inode->prealloc_file_sector = first;
+	inode->prealloc_start = start;
+	inode->prealloc_cnt = cnt;
+	return true;
+}
+
+/* Returns true if FILE_SECTOR of INODE has a sector set aside. */
+static bool
+prealloc_covers (const struct inode *inode, uint32_t file_sector) {
+	return file_sector >= inode->prealloc_file_sector
+		&& file_sector - inode->prealloc_file_sector < inode->prealloc_cnt;
+}
+
+/* Drops the sectors at the front of INODE's preallocation that
+ * have been mapped. */
+static void
+prealloc_trim (struct inode *inode) {
+	while (inode->prealloc_cnt > 0
+			&& extent_lookup (inode, inode->prealloc_file_sector) != NULL) {
+		inode->prealloc_file_sector++;
+		inode->prealloc_start++;
+		inode->prealloc_cnt--;
+	}
+}
+
+/* Gives the sectors set aside for INODE that were never written
+ * back to the free map. */
+static void
+prealloc_release (struct inode *inode) {
+	size_t i;
+
+	for (i = 0; i < inode->prealloc_cnt; i++)
+		if (extent_lookup (inode, inode->prealloc_file_sector + i) == NULL)
+			free_map_release (inode->prealloc_start + i, 1);
+	inode->prealloc_cnt = 0;
+}
+
+/* Returns INODE's pending sector for FILE_SECTOR, or a null
+ * pointer if there is none. */
+static struct pending_sector *
+pending_find (struct inode *inode, uint32_t file_sector) {
+	struct list_elem *e;
+
+	for (e = list_begin (&inode->pending); e != list_end (&inode->pending);
+			e = list_next (e)) {
+		struct pending_sector *p = list_entry (e, struct pending_sector, elem);
+		if (p->file_sector == file_sector)
+			return p;
+	}
+	return NULL;
+}
+
+/* Returns INODE's pending sector for FILE_SECTOR, creating a zeroed
+ * one if there is none.  Returns a null pointer if no free sector
+ * can be reserved for it or memory allocation fails. */
+static struct pending_sector *
+pending_get (struct inode *inode, uint32_t file_sector) {
+	struct pending_sector *p = pending_find (inode, file_sector);
+
+	if (p != NULL)
+		return p;
+	if (!free_map_reserve (mount_of (inode->sector), 1))
+		return NULL;
+	p = calloc (1, sizeof *p);
+	if (p == NULL) {
+		free_map_unreserve (mount_of (inode->sector), 1);
+		return NULL;
+	}
+	p->file_sector = file_sector;
+	list_push_back (&inode->pending, &p->elem);
+	inode->pending_cnt++;
+	return p;
+}
+
+static bool
+pending_less (const struct list_elem *a, const struct list_elem *b,
+		void *aux UNUSED) {
+	return list_entry (a, struct pending_sector, elem)->file_sector
+		< list_entry (b, struct pending_sector, elem)->file_sector;
+}
+
+/* Returns the most log sectors that writing back CNT pending
+ * sectors of INODE, the first of them FILE_SECTOR, as one run can
+ * take: the inode and the overflow blocks extents_store() rewrites,
+ * a new overflow block for every BLOCK_EXTENTS extents the run may
+ * add and its free map sector, the free map sectors of the run,
+ * and the sectors themselves if they are metadata. */
+static size_t
+writeback_cost (const struct inode *inode, uint32_t file_sector,
+		size_t cnt) {
+	size_t i = extent_index (inode, file_sector);
+	size_t block;
+
+	/* The run may be merged into the extent before it. */
+	if (i > 0)
+		i--;
+	block = i < INLINE_EXTENTS ? 0 : (i - INLINE_EXTENTS) / BLOCK_EXTENTS;
+	if (block > 0)
+		block--;
+	return 1 + (inode->block_cnt - block)
+		+ 2 * DIV_ROUND_UP (cnt, BLOCK_EXTENTS) + 2
+		+ (inode->metadata ? cnt : 0);
+}
+
+/* Allocates disk space for INODE's pending sectors, moves their
+ * data into the buffer cache and writes the inode back.  The
+ * sectors are allocated in file order as one run when the free
+ * map has one that long, continuing the preceding extent on disk
+ * when possible, and in the largest runs available otherwise.
+ * Sectors set aside by inode_preallocate() take precedence.  Each
+ * run is only as long as the running journal transaction has room
+ * for, and is complete on disk before the next one starts.
+ * Returns false if some sectors stay pending because the disk,
+ * memory or the transaction ran out. */
+static bool
+pending_writeback (struct inode *inode) {
+	bool success = true;
+
+	if (inode->pending_cnt == 0)
+		return true;
+
+	list_sort (&inode->pending, pending_less, NULL);
+	while (success && !list_empty (&inode->pending)) {
+		struct pending_sector *p = list_entry (list_front (&inode->pending),
+				struct pending_sector, elem);
+		size_t want, cnt = 0, i;
+		size_t first = inode->data.extent_cnt;
+		disk_sector_t start = 0;
+		bool preallocated = prealloc_covers (inode, p->file_sector);
+
+		for (want = inode->pending_cnt; want > 0; want /= 2)
+			if (reserve_log (inode, writeback_cost (inode, p->file_sector, want)))
+				break;
+		if (want == 0)
+			return false;
+
+		/* The reserved sectors are about to be allocated for real. */
+		free_map_unreserve (mount_of (inode->sector), want);
+		if (preallocated) {
+			/* Take the set-aside sectors of the consecutive file
+			 * sectors that follow. */
+			struct list_elem *e = list_next (&p->elem);
+
+			cnt = 1;
+			while (cnt < want && e != list_end (&inode->pending)
+					&& prealloc_covers (inode, p->file_sector + cnt)
+					&& list_entry (e, struct pending_sector, elem)->file_sector
+						== p->file_sector + cnt) {
+				e = list_next (e);
+				cnt++;
+			}
+			start = inode->prealloc_start
+				+ (p->file_sector - inode->prealloc_file_sector);
+		} else {
+			i = extent_index (inode, p->file_sector);
+			if (i > 0) {
+				const struct extent *prev = &inode->extents[i - 1];
+				if (prev->file_sector + prev->length == p->file_sector) {
+					start = prev->start + prev->length;
+					cnt = free_map_allocate_after (start, want);
+				}
+			}
+			if (cnt == 0)
+				for (cnt = want; cnt > 0; cnt /= 2)
+					if (free_map_allocate (mount_of (inode->sector), cnt,
+								&start))
+						break;
+		}
+		free_map_reserve (mount_of (inode->sector), want - cnt);
+
+		for (i = 0; i < cnt; i++) {
+			size_t changed;
+
+			p = list_entry (list_front (&inode->pending), struct pending_sector,
+					elem);
+			if (!extent_insert (inode, p->file_sector, start + i, 1, &changed)) {
+				if (!preallocated)
+					free_map_release (start + i, cnt - i);
+				free_map_reserve (mount_of (inode->sector), cnt - i);
+				break;
+			}
+			if (changed < first)
+				first = changed;
+			data_write (inode, start + i, p->data, 0, DISK_SECTOR_SIZE);
+			list_pop_front (&inode->pending);
+			inode->pending_cnt--;
+			free (p);
+		}
+		success = cnt > 0 && i == cnt;
+		prealloc_trim (inode);
+		extents_store (inode, first);
+	}
+	return success;
+}
+
+/* Drops INODE's pending sectors, which belong to a removed file. */
+static void
+pending_discard (struct inode *inode) {
+	while (!list_empty (&inode->pending))
+		free (list_entry (list_pop_front (&inode->pending),
+					struct pending_sector, elem));
+	free_map_unreserve (mount_of (inode->sector), inode->pending_cnt);
+	inode->pending_cnt = 0;
+}
+
+/* Copies SIZE bytes at SECTOR_OFS of file sector FILE_SECTOR of
+ * INODE, which has no disk space, into BUFFER.  Holes read as
+ * zeros. */
+static void
+unmapped_read (struct inode *inode, uint32_t file_sector, void *buffer,
+		int sector_ofs, int size) {
+	struct pending_sector *p = pending_find (inode, file_sector);
+
+	if (p != NULL)
+		memcpy (buffer, p->data + sector_ofs, size);
+	else
+		memset (buffer, 0, size);
+}
+
+/* Copies SIZE bytes from BUFFER to SECTOR_OFS of file sector
+ * FILE_SECTOR of INODE, which has no disk space yet, through its
+ * pending sector.  Writes pending sectors back once there are
+ * PENDING_MAX of them.  Returns false if the disk is full. */
+static bool
+unmapped_write (struct inode *inode, uint32_t file_sector,
+		const void *buffer, int sector_ofs, int size) {
+	struct pending_sector *p = pending_get (inode, file_sector);
+
+	if (p == NULL)
+		return false;
+	memcpy (p->data + sector_ofs, buffer, size);
+	if (inode->pending_cnt >= PENDING_MAX)
+		pending_writeback (inode);
+	return true;
+}
+
+/* Writes back INODE's pending sectors, taking its rw lock, in as
+ * many journal operations as it takes if the running one is the
+ * outermost.  Must be called with no lock held that a journal
+ * operation may wait for.
+ * Returns false if some sectors stay pending. */
+static bool
+pending_flush (struct inode *inode) {
+	bool retried = false;
+
+	for (;;) {
+		size_t left;
+		bool done;
+
+		rwlock_acquire_write (&inode->rw);
+		left = inode->pending_cnt;
+		done = pending_writeback (inode);
+		if (!done && inode->pending_cnt == left) {
+			/* No progress: try once more in a fresh transaction,
+			 * then give up, since the disk or memory ran out. */
+			done = retried;
+			retried = true;
+		} else
+			retried = false;
+		rwlock_release_write (&inode->rw);
+
+		if (done || !journal_restart ())
+			break;
+	}
+	return inode->pending_cnt == 0;
+}
+#endif
+
+static void inode_unhash (struct inode *);
+
+/* Frees the data sectors of removed, closing INODE, takes it out
+ * of the open inode table and then frees its inode sector, in as
+ * many journal operations as it takes if the running one is the
+ * outermost.  Returns false if the transaction ran out of room
+ * first in a nested operation, leaving the rest for another call.
+ * No opener waits for a removed inode until its inode sector is
+ * free to be reused, so restarting cannot deadlock with one. */
+static bool
+inode_release (struct inode *inode) {
+	while (!map_release (inode) || !reserve_log (inode, 1))
+		if (!journal_restart ())
+			return false;
+	inode_unhash (inode);
+#ifdef EFILESYS
+	fat_remove_chain (sector_to_cluster (inode->sector), 0);
+#else
+	free_map_release (inode->sector, 1);
+#endif
+	return true;
+}
+
+/* Returns true if INODE's data lives in its inode sector. */
+static bool
+is_inline (const struct inode *inode) {
+	return (inode->data.flags & INODE_INLINE) != 0;
+}
+
+/* Writes SIZE bytes from BUFFER into inline INODE at OFFSET, which
+ * must end within INODE_INLINE_MAX bytes, and writes the inode
+ * back.  Bytes never written read as zeros. */
+static void
+inline_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	memcpy (inode->data.inline_data + offset, buffer, size);
+	if (offset + size > inode->data.length)
+		inode->data.length = offset + size;
+	map_store (inode);
+}
+
+static off_t write_at (struct inode *, const void *, off_t, off_t);
+
+/* Moves the data of inline INODE out of its inode sector into
+ * ordinary data sectors, so that it can grow past
+ * INODE_INLINE_MAX bytes.
+ * Returns false, leaving INODE inline, if the disk is full or
+ * memory allocation fails. */
+static bool
+inline_spill (struct inode *inode) {
+	off_t length = inode->data.length;
+	uint8_t *data = malloc (INODE_INLINE_MAX);
+	bool success;
+
+	if (data == NULL)
+		return false;
+	memcpy (data, inode->data.inline_data, INODE_INLINE_MAX);
+	memset (inode->data.inline_data, 0, INODE_INLINE_MAX);
+	inode->data.flags &= ~INODE_INLINE;
+	inode->data.length = 0;
+
+	success = write_at (inode, data, length, 0) == length;
+	if (!success) {
+		pending_discard (inode);
+		map_release (inode);
+		inode->data.flags |= INODE_INLINE;
+		memcpy (inode->data.inline_data, data, INODE_INLINE_MAX);
+		inode->data.length = length;
+		map_store (inode);
+	}
+	free (data);
+	return success;
+}
+
+/* Table of open inodes, keyed by sector, so that opening a single
+ * inode twice returns the same `struct inode'.  The table is split
+ * into stripes by sector, each with its own lock, so that opens of
+ * unrelated inodes do not wait for each other. */
+#define OPEN_INODE_STRIPES 16
+
+struct open_inode_stripe {
+	struct hash inodes;                 /* Open inodes in this stripe. */
+	struct lock lock;                   /* Protects INODES and OPEN_CNTs. */
+	struct condition closed;            /* Signaled when an inode leaves
+	                                       INODES or is loaded. */
+};
+
+static struct open_inode_stripe open_inodes[OPEN_INODE_STRIPES];
+
+/* Removed inodes closed inside a nested journal operation whose
+ * transaction had no room to release all of their sectors.  They
+ * stay in the open inode table, closing, and the next
+ * inode_close() outside any operation finishes them. */
+static struct list doomed;
+static struct lock doomed_lock;
+
+/* Number of inodes of each mount in memory.  An inode counts until
+ * inode_close() is done with it, after it has left the open inode
+ * table, so that a mount is not torn down under a closing inode. */
+static int mount_cnt[MOUNT_MAX];
+static struct lock mount_cnt_lock;
+
+static uint64_t
+open_inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+static bool
+open_inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
+
+/* Returns the stripe of the open inode table that holds SECTOR. */
+static struct open_inode_stripe *
+stripe_of (disk_sector_t sector) {
+	return &open_inodes[sector % OPEN_INODE_STRIPES];
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	size_t i;
+
+	for (i = 0; i < OPEN_INODE_STRIPES; i++) {
+		if (!hash_init (&open_inodes[i].inodes, open_inode_hash,
+					open_inode_less, NULL))
+			PANIC ("open inode table creation failed");
+		lock_init (&open_inodes[i].lock);
+		cond_init (&open_inodes[i].closed);
+	}
+	list_init (&doomed);
+	lock_init (&doomed_lock);
+	lock_init (&mount_cnt_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -67,6 +1093,7 @@ inode_init (void) {
 bool
 inode_create (disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
+	struct inode *inode;
 	bool success = false;
 
 	ASSERT (length >= 0);
@@ -74,66 +1101,142 @@ inode_create (disk_sector_t sector, off_t length) {
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
 	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+#ifndef EFILESYS
+	ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
+#endif
 
 	disk_inode = calloc (1, sizeof *disk_inode);
+	journal_begin ();
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
+		disk_inode->length = 0;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		if (length <= (off_t) INODE_INLINE_MAX) {
+			/* Small enough to live in the inode sector. */
+			disk_inode->length = length;
+			disk_inode->flags = INODE_INLINE;
+		}
+		buffer_cache_write_meta (sector, disk_inode, 0, DISK_SECTOR_SIZE);
 		free (disk_inode);
+
+		/* Grow the empty inode to its initial size, which is a hole
+		 * unless the file system cannot represent one. */
+		if (length <= (off_t) INODE_INLINE_MAX)
+			success = true;
+		else if ((inode = inode_open (sector)) != NULL) {
+			success = inode_extend (inode, length);
+			if (!success) {
+				map_release (inode);
+				inode->data.length = 0;
+				map_store (inode);
+			}
+			inode_close (inode);
+		}
 	}
+	journal_end ();
 	return success;
 }
 
 /* Reads an inode from SECTOR
  * and returns a `struct inode' that contains it.
- * Returns a null pointer if memory allocation fails. */
+ * Returns a null pointer if memory allocation fails, or if SECTOR
+ * holds a removed inode that is still being released.
+ * If the inode is being closed, waits until it has been written
+ * back and read it afresh; if another opener is reading it, waits
+ * for that. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
-	struct inode *inode;
+	struct open_inode_stripe *stripe = stripe_of (sector);
+	struct inode key, *inode;
+	struct hash_elem *e;
+	bool loaded;
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
+	key.sector = sector;
+	lock_acquire (&stripe->lock);
+	while ((e = hash_find (&stripe->inodes, &key.elem)) != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		if (!inode->closing && !inode->loading) {
+			inode->open_cnt++;
+			lock_release (&stripe->lock);
+			return inode;
+		}
+		if (inode->closing && inode->removed) {
+			lock_release (&stripe->lock);
+			return NULL;
 		}
+		cond_wait (&stripe->closed, &stripe->lock);
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&stripe->lock);
 		return NULL;
+	}
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize, and put the inode in the table marked loading
+	 * before reading it, so that a concurrent opener of SECTOR waits
+	 * for this read while openers of other inodes in the stripe go
+	 * ahead. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	inode->closing = false;
+	inode->loading = true;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->metadata = false;
+	rwlock_init (&inode->rw);
+	lock_init (&inode->dir_lock);
+	hash_insert (&stripe->inodes, &inode->elem);
+	lock_release (&stripe->lock);
+
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	loaded = map_load (inode);
+	if (loaded) {
+		/* Count it before another opener can close it. */
+		lock_acquire (&mount_cnt_lock);
+		mount_cnt[mount_id (sector)]++;
+		lock_release (&mount_cnt_lock);
+	}
+
+	lock_acquire (&stripe->lock);
+	inode->loading = false;
+	if (!loaded)
+		hash_delete (&stripe->inodes, &inode->elem);
+	cond_broadcast (&stripe->closed, &stripe->lock);
+	lock_release (&stripe->lock);
+	if (!loaded) {
+		free (inode);
+		return NULL;
+	}
 	return inode;
 }
 
+/* Returns true if SECTOR holds an inode, which tells a formatted
+ * disk from a blank one and an inode from garbage. */
+bool
+inode_valid (disk_sector_t sector) {
+	struct inode_disk *disk_inode = malloc (sizeof *disk_inode);
+	bool valid;
+
+	if (disk_inode == NULL)
+		return false;
+	buffer_cache_read (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+	valid = disk_inode->magic == INODE_MAGIC && map_valid (disk_inode);
+	free (disk_inode);
+	return valid;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		struct open_inode_stripe *stripe = stripe_of (inode->sector);
+
+		lock_acquire (&stripe->lock);
 		inode->open_cnt++;
+		lock_release (&stripe->lock);
+	}
 	return inode;
 }
 
@@ -143,29 +1246,214 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
+/* Takes INODE, whose last opener closed it, out of the open inode
+ * table and wakes up the threads waiting to open it again. */
+static void
+inode_unhash (struct inode *inode) {
+	struct open_inode_stripe *stripe = stripe_of (inode->sector);
+
+	lock_acquire (&stripe->lock);
+	hash_delete (&stripe->inodes, &inode->elem);
+	cond_broadcast (&stripe->closed, &stripe->lock);
+	lock_release (&stripe->lock);
+}
+
+/* Leaves INODE, whose last opener closed it but whose pending
+ * sectors could not all be written back, in the open inode table
+ * with no openers, and wakes up the threads waiting to open it
+ * again.  The next opener's last close, or inode_flush(), tries to
+ * write them back again; until then they are read from memory. */
+static void
+inode_keep (struct inode *inode) {
+	struct open_inode_stripe *stripe = stripe_of (inode->sector);
+
+	lock_acquire (&stripe->lock);
+	inode->closing = false;
+	cond_broadcast (&stripe->closed, &stripe->lock);
+	lock_release (&stripe->lock);
+}
+
+/* Frees INODE, whose last opener closed it, whose sectors are
+ * written back or released and which has left the open inode
+ * table. */
+static void
+inode_free (struct inode *inode) {
+	int id = mount_id (inode->sector);
+
+	map_free (inode);
+	free (inode);
+
+	lock_acquire (&mount_cnt_lock);
+	mount_cnt[id]--;
+	lock_release (&mount_cnt_lock);
+}
+
+/* Finishes releasing the inodes in DOOMED, one journal operation
+ * each.  Must be called outside any journal operation. */
+static void
+inode_reap (void) {
+	for (;;) {
+		struct inode *inode = NULL;
+		bool released;
+
+		lock_acquire (&doomed_lock);
+		if (!list_empty (&doomed))
+			inode = list_entry (list_pop_front (&doomed), struct inode,
+					batch_elem);
+		lock_release (&doomed_lock);
+		if (inode == NULL)
+			break;
+
+		journal_begin ();
+		released = inode_release (inode);
+		journal_end ();
+		if (!released) {
+			lock_acquire (&doomed_lock);
+			list_push_front (&doomed, &inode->batch_elem);
+			lock_release (&doomed_lock);
+			break;
+		}
+		inode_free (inode);
+	}
+}
+
 /* Closes INODE and writes it to disk.
  * If this was the last reference to INODE, frees its memory.
- * If INODE was also a removed inode, frees its blocks. */
+ * If INODE was also a removed inode, frees its blocks.  This is
+ * one journal operation, or several if it is the outermost and
+ * too big for one transaction.
+ *
+ * The last opener keeps INODE in the open inode table, closing,
+ * until it is written back or released, so that a new opener
+ * waits for it instead of reading the inode from disk before it
+ * gets there.  The operation is started, and the pending sectors
+ * written back in as many operations as they take, before INODE
+ * is marked closing, so that nothing after that waits for a
+ * commit that a waiting opener's operation would hold up.  If
+ * pending sectors of a file that was not removed still cannot be
+ * written back, INODE stays in memory with them, for later. */
 void
 inode_close (struct inode *inode) {
+	struct open_inode_stripe *stripe;
+	bool last, kept = false, released = true;
+
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
 
+	stripe = stripe_of (inode->sector);
+	lock_acquire (&stripe->lock);
+	if (inode->open_cnt > 1) {
+		inode->open_cnt--;
+		lock_release (&stripe->lock);
+		goto done;
+	}
+	lock_release (&stripe->lock);
+
+	journal_begin ();
+	if (!inode->removed)
+		pending_flush (inode);
+
+	/* Another opener may have come along meanwhile. */
+	lock_acquire (&stripe->lock);
+	last = --inode->open_cnt == 0;
+	if (last)
+		inode->closing = true;
+	lock_release (&stripe->lock);
+
 	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+	if (last) {
+		rwlock_acquire_write (&inode->rw);
+		if (inode->removed)
+			pending_discard (inode);
+		else
+			kept = !pending_writeback (inode);
+		rwlock_release_write (&inode->rw);
+		prealloc_release (inode);
 
 		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+		if (inode->removed)
+			released = inode_release (inode);
+		else if (kept)
+			inode_keep (inode);
+		else
+			inode_unhash (inode);
+	}
+	journal_end ();
+
+	if (last && !kept) {
+		if (released)
+			inode_free (inode);
+		else {
+			lock_acquire (&doomed_lock);
+			list_push_back (&doomed, &inode->batch_elem);
+			lock_release (&doomed_lock);
 		}
+	}
 
-		free (inode); 
+done:
+	if (!journal_in_operation ())
+		inode_reap ();
+}
+
+/* Writes back the pending sectors of every open inode, one journal
+ * operation each, and finishes releasing removed inodes. */
+void
+inode_flush (void) {
+	struct list batch;
+	size_t i;
+
+	/* Hold each inode open, so that it can be written back without
+	 * its stripe locked, which a running operation may wait for. */
+	list_init (&batch);
+	for (i = 0; i < OPEN_INODE_STRIPES; i++) {
+		struct open_inode_stripe *stripe = &open_inodes[i];
+		struct hash_iterator it;
+
+		lock_acquire (&stripe->lock);
+		hash_first (&it, &stripe->inodes);
+		while (hash_next (&it)) {
+			struct inode *inode = hash_entry (hash_cur (&it), struct inode, elem);
+
+			/* Its last opener writes it back; a loading inode has
+			 * nothing to write back. */
+			if (inode->closing || inode->loading)
+				continue;
+			inode->open_cnt++;
+			list_push_back (&batch, &inode->batch_elem);
+		}
+		lock_release (&stripe->lock);
 	}
+
+	while (!list_empty (&batch)) {
+		struct inode *inode = list_entry (list_pop_front (&batch),
+				struct inode, batch_elem);
+
+		journal_begin ();
+		pending_flush (inode);
+		journal_end ();
+		inode_close (inode);
+	}
+	inode_reap ();
+}
+
+/* Returns the number of inodes of mount ID in memory, including
+ * those being closed and those kept with pending sectors. */
+int
+inode_mount_cnt (int id) {
+	int cnt;
+
+	lock_acquire (&mount_cnt_lock);
+	cnt = mount_cnt[id];
+	lock_release (&mount_cnt_lock);
+	return cnt;
+}
+
+/* Marks INODE as holding file system metadata, such as a directory.
+ * Its writes are logged in the journal. */
+void
+inode_set_metadata (struct inode *inode) {
+	inode->metadata = true;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -176,14 +1464,23 @@ inode_remove (struct inode *inode) {
 	inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
- * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET.
+ * Must be called with INODE's rw lock held. */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+
+	if (is_inline (inode)) {
+		off_t left = inode_length (inode) - offset;
+
+		if (size > left)
+			size = left;
+		if (size <= 0)
+			return 0;
+		memcpy (buffer, inode->data.inline_data + offset, size);
+		return size;
+	}
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,45 +1497,86 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Copy the chunk out of the buffer cache, or out of memory
+		 * if the sector has no disk space. */
+		if (sector_idx == (disk_sector_t) -1)
+			unmapped_read (inode, offset / DISK_SECTOR_SIZE, buffer + bytes_read,
+					sector_ofs, chunk_size);
+		else
+			buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
- * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+ * Returns the number of bytes actually read, which may be less
+ * than SIZE if an error occurs or end of file is reached.
+ * Readers of the same inode run concurrently. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	off_t bytes_read;
+
+	rwlock_acquire_read (&inode->rw);
+	bytes_read = read_at (inode, buffer, size, offset);
+	rwlock_release_read (&inode->rw);
+	return bytes_read;
+}
+
+/* Starts asynchronous reads of the sectors holding the SIZE bytes
+ * of INODE at OFFSET, so that a later inode_read_at() finds them
+ * in the buffer cache.  Does not wait for the disk. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end;
+
+	rwlock_acquire_read (&inode->rw);
+
+	/* Inline data came in with the inode. */
+	if (is_inline (inode)) {
+		rwlock_release_read (&inode->rw);
+		return;
+	}
+
+	end = offset + size < inode_length (inode)
+		? offset + size : inode_length (inode);
+	for (offset -= offset % DISK_SECTOR_SIZE; offset < end;
+			offset += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector (inode, offset);
+		if (sector != (disk_sector_t) -1)
+			buffer_cache_readahead (sector);
+	}
+	rwlock_release_read (&inode->rw);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * Must be called with INODE's rw lock held for writing. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
-	if (inode->deny_write_cnt)
-		return 0;
+	/* A small file lives in its inode sector until it outgrows it. */
+	if (is_inline (inode) && size > 0) {
+		if (offset + size <= (off_t) INODE_INLINE_MAX) {
+			inline_write (inode, buffer, size, offset);
+			return size;
+		}
+		if (!inline_spill (inode))
+			return 0;
+	}
+
+	/* Grow the file, or as much of it as the disk allows. */
+	if (size > 0 && offset + size > inode_length (inode)
+			&& !inode_extend (inode, offset + size))
+		size = inode_length (inode) > offset ? inode_length (inode) - offset : 0;
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -255,45 +1593,99 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* Copy the chunk into the buffer cache, which reads in the
+		 * rest of the sector first when the chunk is partial.  A
+		 * sector without disk space becomes pending instead. */
+		if (sector_idx == (disk_sector_t) -1) {
+			if (!unmapped_write (inode, offset / DISK_SECTOR_SIZE,
+						buffer + bytes_written, sector_ofs, chunk_size))
+				break;
+		} else
+			data_write (inode, sector_idx, buffer + bytes_written, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+
+	/* Metadata gets disk space right away, so that the journal
+	 * covers it. */
+	if (inode->metadata)
+		pending_writeback (inode);
 
 	return bytes_written;
 }
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * A write past end of file extends the inode first.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if the disk fills up or an error occurs.
+ * Writers of the same inode exclude each other and its readers;
+ * those of different inodes run concurrently. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	const uint8_t *buf = buffer;
+	off_t bytes_written = 0;
+
+	/* Begin the operation before taking the rw lock, which a
+	 * running operation may be waiting for.  A write that the
+	 * transaction has no room for goes on in the next one, unless
+	 * it is part of a bigger operation. */
+	journal_begin ();
+	for (;;) {
+		off_t n = 0;
+
+		rwlock_acquire_write (&inode->rw);
+		if (!inode->deny_write_cnt)
+			n = write_at (inode, buf + bytes_written, size - bytes_written,
+					offset + bytes_written);
+		rwlock_release_write (&inode->rw);
+
+		bytes_written += n;
+		if (n == 0 || bytes_written == size || !journal_restart ())
+			break;
+	}
+	journal_end ();
+	return bytes_written;
+}
+
+/* Grows INODE to LENGTH bytes, if it is shorter, and sets aside a
+ * contiguous run of disk sectors for its unallocated end, so that
+ * writing the file sequentially lays it out in one extent.  The
+ * sectors only become part of the file as they are written, so
+ * unwritten parts still read as zeros.
+ * Returns false if the disk is full or memory allocation fails. */
+bool
+inode_preallocate (struct inode *inode, off_t length) {
+	bool success = true;
+
+	journal_begin ();
+	rwlock_acquire_write (&inode->rw);
+	if (is_inline (inode) && length > (off_t) INODE_INLINE_MAX)
+		success = inline_spill (inode);
+	if (success && !is_inline (inode)) {
+		if (length > inode_length (inode))
+			success = inode_extend (inode, length);
+		if (success)
+			success = map_preallocate (inode);
+	}
+	rwlock_release_write (&inode->rw);
+	journal_end ();
+	return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rw);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +1693,34 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->rw);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rw);
+}
+
+/* Acquires the lock that serializes operations on directory
+ * INODE, such as adding and removing entries. */
+void
+inode_dir_lock (struct inode *inode) {
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_dir_unlock (struct inode *inode) {
+	lock_release (&inode->dir_lock);
+}
+
+/* Calls FN with AUX for each run of disk sectors that INODE uses,
+ * other than its inode sector, giving the first sector and the
+ * number of sectors.  Sectors not written back yet are left out. */
+void
+inode_map_runs (struct inode *inode, inode_run_func *fn, void *aux) {
+	rwlock_acquire_read (&inode->rw);
+	map_runs (inode, fn, aux);
+	rwlock_release_read (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
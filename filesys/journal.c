@@ -0,0 +1,711 @@
+/* journal.c: Redo journal for file system metadata.
+ *
+ * Metadata sectors (inodes, extent blocks, directories, the free
+ * map and the FAT) are written through buffer_cache_write_meta(),
+ * which logs a copy of each one into the running transaction.  A
+ * sector in the running transaction stays in the buffer cache
+ * until the transaction is committed: written to the journal
+ * region as a header sector, the sector copies, and a commit
+ * sector.  Only then may the cache write it to its home location,
+ * which is the checkpoint.  Checkpoints happen lazily, as sectors
+ * are evicted, and all at once when the journal runs out of space.
+ *
+ * After a crash, journal_init() replays every transaction that was
+ * completely committed, so each operation that ran inside a
+ * journal_begin() / journal_end() pair either happened entirely
+ * or not at all.
+ *
+ * An operation never finds the transaction full.  journal_begin()
+ * sets JOURNAL_OP_MAX log sectors aside for it, committing first
+ * if the transaction has no room for them; an operation that may
+ * log more asks for them with journal_reserve() before it changes
+ * anything, and backs off or stops early if they are refused.  The
+ * allocation map sectors that operations dirty are counted against
+ * the same room, since the next commit logs them all.
+ *
+ * A freed metadata sector may be reused for data, which is not
+ * logged.  Replaying an older copy of it would overwrite that
+ * data, so a commit that follows such a free writes everything
+ * home and empties the log first, and a copy of the sector in the
+ * running transaction is dropped.
+ *
+ * The superblock also holds the dirty-region log, which tells the
+ * file system checker which parts of the disk to look at after an
+ * unclean shutdown.  The disk is split into JOURNAL_REGIONS
+ * regions.  A region is marked dirty before any metadata sector in
+ * it, or any free map bit for a sector in it, can reach the disk,
+ * and all regions are clean again after a clean shutdown. */
+
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/mount.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identify journal sectors. */
+#define JOURNAL_SUPER_MAGIC 0x4c4e524a
+#define JOURNAL_HEADER_MAGIC 0x5244484a
+#define JOURNAL_COMMIT_MAGIC 0x4d4d434a
+
+/* Number of regions in the dirty-region log. */
+#define JOURNAL_REGIONS (496 * 8)
+
+/* Journal superblock flags. */
+#define SUPER_CLEAN 0x1                 /* Shut down cleanly. */
+#define SUPER_REGIONS 0x2               /* REGIONS is valid. */
+
+/* First sector of the journal region.  Says where replay starts;
+ * transactions follow it in order.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_super {
+	unsigned magic;                     /* JOURNAL_SUPER_MAGIC. */
+	uint32_t flags;                     /* SUPER_* flags. */
+	uint64_t seq;                       /* Transaction at sector 1. */
+	uint8_t regions[JOURNAL_REGIONS / 8];   /* Dirty-region log, one bit
+	                                           per region. */
+};
+
+/* Starts a transaction in the log.  Followed by CNT sector copies
+ * and a commit sector.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_header {
+	unsigned magic;                     /* JOURNAL_HEADER_MAGIC. */
+	uint32_t cnt;                       /* Number of sectors logged. */
+	uint64_t seq;                       /* Transaction number. */
+	disk_sector_t sectors[JOURNAL_TXN_MAX]; /* Home of each copy. */
+	uint8_t unused[496 - JOURNAL_TXN_MAX * sizeof (disk_sector_t)];
+};
+
+/* Ends a transaction in the log.  A transaction counts only if
+ * its commit sector matches the header and the copies.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_commit {
+	unsigned magic;                     /* JOURNAL_COMMIT_MAGIC. */
+	uint32_t cnt;                       /* Number of sectors logged. */
+	uint64_t seq;                       /* Transaction number. */
+	uint64_t checksum;                  /* Of the header and copies. */
+	uint8_t unused[488];                /* Not used. */
+};
+
+/* The running transaction, laid out as it is written to the log:
+ * the header sector, then the sector copies. */
+static struct {
+	struct journal_header header;
+	uint8_t copies[JOURNAL_TXN_MAX][DISK_SECTOR_SIZE];
+} txn;
+
+/* Journal state.  journal_lock protects TXN and everything below
+ * except COMMITTED_SEQ, which is read without it. */
+static struct lock journal_lock;
+static struct condition journal_idle;   /* Signaled when HANDLE_CNT is 0. */
+static struct condition commit_done;    /* Signaled when a commit ends. */
+static bool journal_active;             /* Logging sectors? */
+static int handle_cnt;                  /* Threads between begin and end. */
+static bool committing;                 /* A commit is in progress. */
+static uint64_t running_seq;            /* Number of the running txn. */
+static uint64_t committed_seq;          /* Last committed txn. */
+static disk_sector_t log_first;         /* First sector of the region. */
+static size_t log_head;                 /* Next free sector in the region. */
+static uint64_t super_seq;              /* Transaction at sector 1. */
+static size_t reserved_cnt;             /* Log sectors set aside for
+                                           running operations. */
+static size_t map_cnt;                  /* Dirty allocation map sectors,
+                                           which the next commit logs. */
+
+/* Home sectors of the copies in the log, one bit per sector below
+ * LOG_FIRST.  REVOKED is set when one of them was freed. */
+static struct bitmap *logged;
+static bool revoked;
+
+/* Dirty-region log.  REGIONS_CHANGED is set when a region became
+ * dirty since the superblock was last written. */
+static uint8_t regions[JOURNAL_REGIONS / 8];
+static bool regions_changed;
+static disk_sector_t region_sectors;    /* Sectors per region. */
+static bool was_clean;                  /* Last shutdown was clean? */
+
+/* How often the running transaction is committed, in timer ticks. */
+#define JOURNAL_COMMIT_INTERVAL (5 * TIMER_FREQ)
+
+/* Commit requests for the journal daemon.  COMMIT_REQUESTED is set,
+ * with interrupts off, while COMMIT_WANTED holds an unconsumed up. */
+static struct semaphore commit_wanted;
+static bool commit_requested;
+
+/* Statistics. */
+static long long commit_cnt;            /* Transactions committed. */
+static long long logged_cnt;            /* Sectors written to the log. */
+static long long checkpoint_cnt;        /* Full checkpoints. */
+static long long revoke_cnt;            /* Of those, forced by a free. */
+
+static void journald (void *aux);
+static void journal_timer (void *aux);
+
+/* Returns a checksum of transaction header H and its copies. */
+static uint64_t
+journal_checksum (const struct journal_header *h, const void *copies) {
+	return hash_bytes (h, sizeof *h)
+		^ hash_bytes (copies, h->cnt * DISK_SECTOR_SIZE);
+}
+
+/* Writes a journal superblock saying that replay starts with
+ * transaction SEQ, along with the dirty-region log, or that the
+ * file system was shut down cleanly if CLEAN is true. */
+static void
+super_write (uint64_t seq, bool clean) {
+	struct journal_super *sb = calloc (1, sizeof *sb);
+
+	if (sb == NULL)
+		PANIC ("journal superblock allocation failed");
+	sb->magic = JOURNAL_SUPER_MAGIC;
+	sb->flags = SUPER_REGIONS | (clean ? SUPER_CLEAN : 0);
+	sb->seq = seq;
+	if (!clean)
+		memcpy (sb->regions, regions, sizeof regions);
+	disk_write (filesys_disk, log_first, sb);
+	free (sb);
+	super_seq = seq;
+	regions_changed = false;
+}
+
+/* Marks the regions of the CNT sectors starting at SECTOR dirty.
+ * Must be called with journal_lock held. */
+static void
+mark_regions (disk_sector_t sector, size_t cnt) {
+	size_t r, last;
+
+	if (cnt == 0 || mount_id (sector) != 0)
+		return;
+	last = (sector + cnt - 1) / region_sectors;
+	for (r = sector / region_sectors; r <= last && r < JOURNAL_REGIONS; r++)
+		if (!(regions[r / 8] & (1 << r % 8))) {
+			regions[r / 8] |= 1 << r % 8;
+			regions_changed = true;
+		}
+}
+
+/* Writes the home sectors of every complete transaction in the
+ * log, starting with transaction SEQ at sector 1 of the region.
+ * Returns the number of the first transaction not replayed. */
+static uint64_t
+journal_replay (uint64_t seq) {
+	struct journal_header *h = malloc (sizeof *h);
+	struct journal_commit *c = malloc (sizeof *c);
+	uint8_t *copies = malloc (JOURNAL_TXN_MAX * DISK_SECTOR_SIZE);
+	size_t pos = 1, replayed = 0;
+
+	if (h == NULL || c == NULL || copies == NULL)
+		PANIC ("journal replay allocation failed");
+
+	while (pos + 2 <= JOURNAL_SECTORS) {
+		size_t i;
+
+		disk_read (filesys_disk, log_first + pos, h);
+		if (h->magic != JOURNAL_HEADER_MAGIC || h->seq != seq
+				|| h->cnt > JOURNAL_TXN_MAX || pos + h->cnt + 2 > JOURNAL_SECTORS)
+			break;
+		disk_read_multiple (filesys_disk, log_first + pos + 1, copies, h->cnt);
+		disk_read (filesys_disk, log_first + pos + h->cnt + 1, c);
+		if (c->magic != JOURNAL_COMMIT_MAGIC || c->seq != seq
+				|| c->cnt != h->cnt || c->checksum != journal_checksum (h, copies))
+			break;
+
+		for (i = 0; i < h->cnt; i++)
+			disk_write (filesys_disk, h->sectors[i],
+					copies + i * DISK_SECTOR_SIZE);
+		pos += h->cnt + 2;
+		seq++;
+		replayed++;
+	}
+	if (replayed > 0)
+		printf ("Journal: replayed %zu transactions.\n", replayed);
+
+	free (copies);
+	free (c);
+	free (h);
+	return seq;
+}
+
+/* Initializes the journal, replaying committed transactions left
+ * by an unclean shutdown unless FORMAT is true, in which case the
+ * journal starts out empty.  Must run before anything else reads
+ * the file system. */
+void
+journal_init (bool format) {
+	struct journal_super *sb;
+	uint64_t seq = 1;
+
+	ASSERT (sizeof (struct journal_super) == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct journal_header) == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct journal_commit) == DISK_SECTOR_SIZE);
+	ASSERT (disk_size (filesys_disk) > JOURNAL_SECTORS);
+
+	lock_init (&journal_lock);
+	cond_init (&journal_idle);
+	cond_init (&commit_done);
+	log_first = journal_start ();
+	region_sectors = DIV_ROUND_UP (log_first, JOURNAL_REGIONS);
+	logged = bitmap_create (log_first);
+	if (logged == NULL)
+		PANIC ("journal bitmap allocation failed");
+
+	sb = malloc (sizeof *sb);
+	if (sb == NULL)
+		PANIC ("journal superblock allocation failed");
+	disk_read (filesys_disk, log_first, sb);
+	was_clean = format;
+	if (!format && sb->magic == JOURNAL_SUPER_MAGIC) {
+		seq = journal_replay (sb->seq);
+		was_clean = (sb->flags & SUPER_CLEAN) != 0;
+	}
+	/* Regions left dirty stay dirty until they are checked.  Without
+	 * a log, all of them are. */
+	if (!was_clean) {
+		if (sb->magic == JOURNAL_SUPER_MAGIC && (sb->flags & SUPER_REGIONS))
+			memcpy (regions, sb->regions, sizeof regions);
+		else
+			memset (regions, 0xff, sizeof regions);
+	}
+	free (sb);
+
+	/* Everything replayed is home; start over at sector 1. */
+	super_write (seq, false);
+	running_seq = seq;
+	committed_seq = seq - 1;
+	log_head = 1;
+	journal_active = true;
+
+	sema_init (&commit_wanted, 0);
+	commit_requested = false;
+	if (thread_create ("journald", PRI_DEFAULT, journald, NULL) == TID_ERROR
+			|| thread_create ("journal-timer", PRI_DEFAULT, journal_timer,
+				NULL) == TID_ERROR)
+		PANIC ("journal daemon creation failed");
+}
+
+/* Returns the first sector of the journal region. */
+disk_sector_t
+journal_start (void) {
+	return disk_size (filesys_disk) - JOURNAL_SECTORS;
+}
+
+/* Returns the number of sectors the running transaction has room
+ * for beyond those already set aside.
+ * Must be called with journal_lock held. */
+static size_t
+txn_room (void) {
+	size_t used = txn.header.cnt + map_cnt + reserved_cnt;
+
+	return used < JOURNAL_TXN_MAX ? JOURNAL_TXN_MAX - used : 0;
+}
+
+/* Starts an operation whose metadata updates must reach the disk
+ * together, with JOURNAL_OP_MAX log sectors set aside for it.
+ * Calls nest; the operation ends with the outermost journal_end().
+ * Waits while a transaction is being committed, and commits the
+ * running one first if it has no room for the operation. */
+void
+journal_begin (void) {
+	struct thread *t = thread_current ();
+
+	if (t->journal_depth++ > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	for (;;) {
+		while (committing)
+			cond_wait (&commit_done, &journal_lock);
+		if (!journal_active || txn_room () >= JOURNAL_OP_MAX)
+			break;
+
+		lock_release (&journal_lock);
+		journal_commit ();
+		lock_acquire (&journal_lock);
+	}
+	handle_cnt++;
+	if (journal_active) {
+		reserved_cnt += JOURNAL_OP_MAX;
+		t->journal_credits = JOURNAL_OP_MAX;
+	}
+	lock_release (&journal_lock);
+}
+
+/* Ends an operation started by journal_begin().  Its updates are
+ * committed later, with those of other operations, and the log
+ * sectors it did not use are given back. */
+void
+journal_end (void) {
+	struct thread *t = thread_current ();
+
+	ASSERT (t->journal_depth > 0);
+	if (--t->journal_depth > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	reserved_cnt -= t->journal_credits;
+	t->journal_credits = 0;
+	if (--handle_cnt == 0)
+		cond_broadcast (&journal_idle, &journal_lock);
+	lock_release (&journal_lock);
+}
+
+/* Ends the running operation and starts another, so that work
+ * too big for one transaction can go on in the next.  The caller
+ * must hold no lock that an operation may wait for.  Returns false,
+ * doing nothing, if the operation is nested in another. */
+bool
+journal_restart (void) {
+	if (thread_current ()->journal_depth != 1)
+		return false;
+	journal_end ();
+	journal_begin ();
+	return true;
+}
+
+/* Returns true if the running thread is inside an operation. */
+bool
+journal_in_operation (void) {
+	return thread_current ()->journal_depth > 0;
+}
+
+/* Makes sure that the running operation can log CNT more sectors,
+ * setting more aside if it has fewer left.  Never waits for a
+ * commit, which could not start before the operation ends.
+ * Returns false if the transaction has no room for them, in which
+ * case the operation must not log them. */
+bool
+journal_reserve (size_t cnt) {
+	struct thread *t = thread_current ();
+	bool success = true;
+
+	ASSERT (t->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	if (journal_active && t->journal_credits < cnt) {
+		size_t more = cnt - t->journal_credits;
+
+		success = txn_room () >= more;
+		if (success) {
+			reserved_cnt += more;
+			t->journal_credits += more;
+		}
+	}
+	lock_release (&journal_lock);
+	return success;
+}
+
+/* Counts CNT more allocation map sectors of the root file system
+ * as dirty, taking room for them from the running operation, or
+ * from the transaction if the operation has too little left. */
+void
+journal_map_dirty (size_t cnt) {
+	struct thread *t = thread_current ();
+	size_t n = t->journal_credits < cnt ? t->journal_credits : cnt;
+
+	lock_acquire (&journal_lock);
+	if (journal_active && txn_room () < cnt - n)
+		PANIC ("journal transaction overflow");
+	map_cnt += cnt;
+	t->journal_credits -= n;
+	reserved_cnt -= n;
+	lock_release (&journal_lock);
+}
+
+/* Counts CNT dirty allocation map sectors as clean again, right
+ * before they are logged or written. */
+void
+journal_map_clean (size_t cnt) {
+	lock_acquire (&journal_lock);
+	map_cnt -= cnt < map_cnt ? cnt : map_cnt;
+	lock_release (&journal_lock);
+}
+
+/* Adds a copy of DATA, the new contents of SECTOR, to the running
+ * transaction.  Must be called between journal_begin() and
+ * journal_end(), and a sector new to the transaction takes one of
+ * the log sectors set aside for the operation.  Returns the number
+ * of the transaction, which SECTOR must not be written home
+ * before, or 0 if the journal is not running. */
+uint64_t
+journal_log (disk_sector_t sector, const void *data) {
+	struct thread *t = thread_current ();
+	uint64_t seq = 0;
+	size_t i;
+
+	ASSERT (t->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	if (journal_active) {
+		for (i = 0; i < txn.header.cnt; i++)
+			if (txn.header.sectors[i] == sector)
+				break;
+		if (i == txn.header.cnt) {
+			if (t->journal_credits > 0) {
+				t->journal_credits--;
+				reserved_cnt--;
+			} else if (txn_room () == 0)
+				PANIC ("journal transaction overflow");
+			txn.header.sectors[txn.header.cnt++] = sector;
+		}
+
+		mark_regions (sector, 1);
+		memcpy (txn.copies[i], data, DISK_SECTOR_SIZE);
+		seq = running_seq;
+	}
+	lock_release (&journal_lock);
+	return seq;
+}
+
+/* Tells the journal that the CNT sectors starting at SECTOR were
+ * freed and may be reused for data.  Copies of them in the running
+ * transaction are dropped, and if older transactions in the log
+ * hold any, the next commit checkpoints first so that they are
+ * never replayed.  Sectors of mounts other than the root are
+ * ignored. */
+void
+journal_revoke (disk_sector_t sector, size_t cnt) {
+	size_t i;
+
+	if (cnt == 0 || mount_id (sector) != 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	if (journal_active && sector + cnt <= log_first) {
+		for (i = 0; i < txn.header.cnt; )
+			if (txn.header.sectors[i] - sector < cnt) {
+				size_t last = --txn.header.cnt;
+
+				txn.header.sectors[i] = txn.header.sectors[last];
+				memcpy (txn.copies[i], txn.copies[last], DISK_SECTOR_SIZE);
+			} else
+				i++;
+		if (bitmap_contains (logged, sector, cnt, true))
+			revoked = true;
+	}
+	lock_release (&journal_lock);
+}
+
+/* Writes every committed sector home and starts the log over at
+ * sector 1, with transaction RUNNING_SEQ.  No operation may be
+ * running, so that every dirty sector in the buffer cache that is
+ * not in the running transaction is committed.
+ * Must be called with journal_lock held. */
+static void
+checkpoint (void) {
+	buffer_cache_flush ();
+	super_write (running_seq, false);
+	log_head = 1;
+	bitmap_set_all (logged, false);
+	revoked = false;
+	checkpoint_cnt++;
+}
+
+/* Returns true if transaction TXN, as returned by journal_log(),
+ * has been committed.  Safe to call with any lock held. */
+bool
+journal_committed (uint64_t txn_seq) {
+	return txn_seq <= committed_seq;
+}
+
+/* Writes the running transaction to the log.  Stops new
+ * operations from starting and waits for running ones to end
+ * first, so that the transaction holds only complete
+ * operations. */
+void
+journal_commit (void) {
+	struct thread *t = thread_current ();
+	struct journal_commit *c;
+	bool committed = false;
+
+	lock_acquire (&journal_lock);
+	if (!journal_active || committing) {
+		/* Somebody else commits the transaction. */
+		while (committing)
+			cond_wait (&commit_done, &journal_lock);
+		lock_release (&journal_lock);
+		return;
+	}
+	committing = true;
+	while (handle_cnt > 0)
+		cond_wait (&journal_idle, &journal_lock);
+	lock_release (&journal_lock);
+
+	/* Log the allocation map sectors changed by the operations in
+	 * the transaction, as this thread's own operation. */
+	t->journal_depth++;
+#ifdef EFILESYS
+	fat_flush ();
+#else
+	free_map_sync (mount_get (0));
+#endif
+	t->journal_depth--;
+
+	lock_acquire (&journal_lock);
+	/* The regions of the sectors in the transaction must be logged
+	 * as dirty before the sectors can be written home. */
+	if (regions_changed)
+		super_write (super_seq, false);
+	if (txn.header.cnt > 0) {
+		size_t i;
+
+		/* A sector freed since it was logged may hold data now. */
+		if (revoked) {
+			checkpoint ();
+			revoke_cnt++;
+		}
+
+		c = calloc (1, sizeof *c);
+		if (c == NULL)
+			PANIC ("journal commit allocation failed");
+
+		/* Header and copies in one sequential write, then the commit
+		 * sector once they are on disk. */
+		txn.header.magic = JOURNAL_HEADER_MAGIC;
+		txn.header.seq = running_seq;
+		disk_write_multiple (filesys_disk, log_first + log_head, &txn,
+				txn.header.cnt + 1);
+		c->magic = JOURNAL_COMMIT_MAGIC;
+		c->cnt = txn.header.cnt;
+		c->seq = running_seq;
+		c->checksum = journal_checksum (&txn.header, txn.copies);
+		disk_write (filesys_disk, log_first + log_head + txn.header.cnt + 1, c);
+		free (c);
+
+		for (i = 0; i < txn.header.cnt; i++)
+			bitmap_mark (logged, txn.header.sectors[i]);
+		log_head += txn.header.cnt + 2;
+		logged_cnt += txn.header.cnt;
+		commit_cnt++;
+		committed_seq = running_seq++;
+		txn.header.cnt = 0;
+		committed = true;
+
+		/* Without room for another full transaction, reuse the log
+		 * from the start. */
+		if (log_head + JOURNAL_TXN_MAX + 2 > JOURNAL_SECTORS)
+			checkpoint ();
+	}
+	committing = false;
+	cond_broadcast (&commit_done, &journal_lock);
+	lock_release (&journal_lock);
+
+	/* Cache entries of the transaction may be evicted now. */
+	if (committed)
+		buffer_cache_committed ();
+}
+
+/* Asks the journal daemon to commit the running transaction, and
+ * returns without waiting for it.  Safe to call with any lock held,
+ * and inside an operation. */
+void
+journal_request_commit (void) {
+	enum intr_level old_level = intr_disable ();
+
+	if (!commit_requested) {
+		commit_requested = true;
+		sema_up (&commit_wanted);
+	}
+	intr_set_level (old_level);
+}
+
+/* Commits the running transaction whenever asked to. */
+static void
+journald (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&commit_wanted);
+		commit_requested = false;
+		journal_commit ();
+	}
+}
+
+/* Asks for a commit every JOURNAL_COMMIT_INTERVAL ticks. */
+static void
+journal_timer (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (JOURNAL_COMMIT_INTERVAL);
+		journal_request_commit ();
+	}
+}
+
+/* Commits the running transaction, writes every committed sector
+ * home and empties the journal, so that the next mount has nothing
+ * to replay.  Metadata written afterward is not logged. */
+void
+journal_close (void) {
+	journal_commit ();
+	buffer_cache_flush ();
+
+	lock_acquire (&journal_lock);
+	super_write (running_seq, true);
+	log_head = 1;
+	bitmap_set_all (logged, false);
+	revoked = false;
+	journal_active = false;
+	lock_release (&journal_lock);
+}
+
+/* Marks the regions of the CNT sectors starting at SECTOR dirty in
+ * the dirty-region log, before free map bits for them change.
+ * Sectors of mounts other than the root are ignored. */
+void
+journal_mark (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&journal_lock);
+	mark_regions (sector, cnt);
+	lock_release (&journal_lock);
+}
+
+/* Returns true if the file system was shut down cleanly, or just
+ * formatted, before this boot. */
+bool
+journal_was_clean (void) {
+	return was_clean;
+}
+
+/* Returns the number of sectors in a region of the dirty-region
+ * log.  Region R starts at sector R times that. */
+disk_sector_t
+journal_region_sectors (void) {
+	return region_sectors;
+}
+
+/* Returns true if the region of SECTOR is dirty. */
+bool
+journal_region_dirty (disk_sector_t sector) {
+	size_t r = sector / region_sectors;
+	bool dirty;
+
+	lock_acquire (&journal_lock);
+	dirty = r < JOURNAL_REGIONS && (regions[r / 8] & (1 << r % 8));
+	lock_release (&journal_lock);
+	return dirty;
+}
+
+/* Marks every region clean, once the file system checker has
+ * repaired them and the repairs are committed.  The log on disk is
+ * updated by the next commit. */
+void
+journal_regions_clear (void) {
+	lock_acquire (&journal_lock);
+	memset (regions, 0, sizeof regions);
+	regions_changed = true;
+	lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) {
+	printf ("Journal: %lld commits, %lld sectors logged, "
+			"%lld checkpoints (%lld after a free)\n",
+			commit_cnt, logged_cnt, checkpoint_cnt, revoke_cnt);
+}
@@ -0,0 +1,112 @@
+/* mount.c: Table of mounted file systems. */
+
+#include "filesys/mount.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/synch.h"
+
+/* Mounted file systems, indexed by mount index.  Entry 0 is the
+ * root file system. */
+static struct mount mounts[MOUNT_MAX];
+
+/* Serializes mounting and unmounting against path lookups that
+ * cross into a mount. */
+static struct lock mounts_lock;
+
+/* Initializes the mount table with ROOT as the root file system. */
+void
+mount_init (struct disk *root) {
+	int i;
+
+	lock_init (&mounts_lock);
+	for (i = 0; i < MOUNT_MAX; i++)
+		mounts[i].id = i;
+	mounts[0].in_use = true;
+	mounts[0].disk = root;
+	mounts[0].name[0] = '\0';
+}
+
+/* Returns mount ID, which must be in use. */
+struct mount *
+mount_get (int id) {
+	ASSERT (id >= 0 && id < MOUNT_MAX);
+	ASSERT (mounts[id].in_use);
+	return &mounts[id];
+}
+
+/* Returns true if mount ID is in use. */
+bool
+mount_used (int id) {
+	return id >= 0 && id < MOUNT_MAX && mounts[id].in_use;
+}
+
+/* Returns the mount that SECTOR belongs to. */
+struct mount *
+mount_of (disk_sector_t sector) {
+	return mount_get (mount_id (sector));
+}
+
+/* Returns the disk that SECTOR is on. */
+struct disk *
+mount_disk (disk_sector_t sector) {
+	return mount_of (sector)->disk;
+}
+
+/* Acquires the mount table lock.  Mounting and unmounting write
+ * back a free map, which starts journal operations, so the lock
+ * must not be acquired inside one. */
+void
+mount_lock (void) {
+	lock_acquire (&mounts_lock);
+}
+
+/* Releases the mount table lock. */
+void
+mount_unlock (void) {
+	lock_release (&mounts_lock);
+}
+
+/* Returns the index of the mount whose mount point is NAME, or -1.
+ * Must be called with the mount table lock held. */
+int
+mount_find (const char *name) {
+	int i;
+
+	ASSERT (lock_held_by_current_thread (&mounts_lock));
+	for (i = 1; i < MOUNT_MAX; i++)
+		if (mounts[i].in_use && !strcmp (mounts[i].name, name))
+			return i;
+	return -1;
+}
+
+/* Adds DISK to the mount table with mount point NAME and returns
+ * its mount index, or -1 if the table is full or DISK is mounted
+ * already.  The caller sets up the rest of the mount.
+ * Must be called with the mount table lock held. */
+int
+mount_add (const char *name, struct disk *disk) {
+	int i;
+
+	ASSERT (lock_held_by_current_thread (&mounts_lock));
+	for (i = 0; i < MOUNT_MAX; i++)
+		if (mounts[i].in_use && mounts[i].disk == disk)
+			return -1;
+	for (i = 1; i < MOUNT_MAX; i++)
+		if (!mounts[i].in_use) {
+			mounts[i].in_use = true;
+			mounts[i].disk = disk;
+			strlcpy (mounts[i].name, name, sizeof mounts[i].name);
+			mounts[i].free_map = NULL;
+			return i;
+		}
+	return -1;
+}
+
+/* Removes mount ID from the mount table.
+ * Must be called with the mount table lock held. */
+void
+mount_remove (int id) {
+	ASSERT (lock_held_by_current_thread (&mounts_lock));
+	ASSERT (id > 0);
+	mount_get (id)->in_use = false;
+}
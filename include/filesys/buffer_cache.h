@@ -0,0 +1,22 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Number of sectors held by the buffer cache. */
+#define BUFFER_CACHE_SIZE 64
+
+void buffer_cache_init (void);
+bool buffer_cache_attach (int id, struct disk *);
+void buffer_cache_detach (int id);
+void buffer_cache_read (disk_sector_t, void *, int sector_ofs, int size);
+void buffer_cache_write (disk_sector_t, const void *, int sector_ofs, int size);
+void buffer_cache_write_meta (disk_sector_t, const void *, int sector_ofs,
+		int size);
+void buffer_cache_readahead (disk_sector_t);
+void buffer_cache_flush (void);
+void buffer_cache_committed (void);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer_cache.h */
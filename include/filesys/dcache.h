@@ -0,0 +1,27 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Number of names held by the dentry cache. */
+#define DCACHE_SIZE 256
+
+/* Result of a dentry cache lookup. */
+enum dcache_result {
+	DCACHE_MISS,                /* Name not cached. */
+	DCACHE_POSITIVE,            /* Name exists; its inode sector is known. */
+	DCACHE_NEGATIVE             /* Name is known not to exist. */
+};
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (disk_sector_t dir, const char *name,
+		disk_sector_t *sectorp);
+void dcache_insert (disk_sector_t dir, const char *name, disk_sector_t);
+void dcache_insert_negative (disk_sector_t dir, const char *name);
+void dcache_invalidate (disk_sector_t dir, const char *name);
+void dcache_invalidate_dir (disk_sector_t dir);
+void dcache_invalidate_mount (int id);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
@@ -22,6 +22,7 @@ void fat_init (void);
 void fat_open (void);
 void fat_close (void);
 void fat_create (void);
+void fat_flush (void);
 void fat_close (void);
 
 cluster_t fat_create_chain (
@@ -34,5 +35,30 @@ void fat_remove_chain (
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
+
+/* Clusters between two checkpoints of a chain index. */
+#define FAT_CHAIN_STRIDE 16
+
+/* Index of one cluster chain, so that finding the cluster at a
+ * given position does not follow the chain from its start.  Keeps
+ * every FAT_CHAIN_STRIDE-th cluster and the last one looked up. */
+struct fat_chain {
+	cluster_t start;            /* First cluster, or 0 if empty. */
+	cluster_t *checkpoints;     /* Cluster #(I * FAT_CHAIN_STRIDE). */
+	size_t checkpoint_cnt;      /* Number of CHECKPOINTS known. */
+	size_t checkpoint_cap;      /* Capacity of CHECKPOINTS. */
+	size_t last_idx;            /* Position of LAST_CLST. */
+	cluster_t last_clst;        /* Last cluster reached, or 0. */
+	size_t length;              /* Number of clusters, if TAIL != 0. */
+	cluster_t tail;             /* Last cluster, or 0 if not known yet. */
+};
+
+void fat_chain_init (struct fat_chain *, cluster_t start);
+void fat_chain_destroy (struct fat_chain *);
+cluster_t fat_chain_seek (struct fat_chain *, size_t idx);
+size_t fat_chain_length (struct fat_chain *);
+cluster_t fat_chain_extend (struct fat_chain *);
+bool fat_chain_release (struct fat_chain *);
 
 #endif /* filesys/fat.h */
@@ -6,7 +6,12 @@
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#define ROOT_DIR_SECTOR cluster_to_sector (ROOT_DIR_CLUSTER)
+#else
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#endif
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
@@ -16,5 +21,9 @@ void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+struct dir *filesys_open_dir (const char *name);
+bool filesys_mount (const char *name, int chan, int dev);
+bool filesys_umount (const char *name);
+bool filesys_mkfs (int chan, int dev);
 
 #endif /* filesys/filesys.h */
@@ -0,0 +1,9 @@
+#ifndef FILESYS_FSCK_H
+#define FILESYS_FSCK_H
+
+/* Number of threads that walk the directory tree. */
+#define FSCK_THREADS 4
+
+void fsck_run (void);
+
+#endif /* filesys/fsck.h */
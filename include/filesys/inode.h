@@ -7,17 +7,29 @@
 
 struct bitmap;
 
+/* Called by inode_map_runs() for CNT sectors starting at START. */
+typedef void inode_run_func (disk_sector_t start, size_t cnt, void *aux);
+
 void inode_init (void);
 bool inode_create (disk_sector_t, off_t);
 struct inode *inode_open (disk_sector_t);
+bool inode_valid (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+void inode_set_metadata (struct inode *);
+void inode_flush (void);
+int inode_mount_cnt (int id);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t offset, off_t size);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_preallocate (struct inode *, off_t length);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_dir_lock (struct inode *);
+void inode_dir_unlock (struct inode *);
+void inode_map_runs (struct inode *, inode_run_func *, void *aux);
 off_t inode_length (const struct inode *);
 
 #endif /* filesys/inode.h */
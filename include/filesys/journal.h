@@ -0,0 +1,44 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/disk.h"
+
+/* Size of the journal, which occupies the last sectors of the file
+ * system disk. */
+#define JOURNAL_SECTORS 256
+
+/* Most metadata sectors one transaction holds.  They stay in the
+ * buffer cache until the transaction commits, so this must leave
+ * the cache plenty of other entries to evict. */
+#define JOURNAL_TXN_MAX 32
+
+/* Log sectors journal_begin() sets aside for an operation.  One
+ * that may log more asks for them with journal_reserve(). */
+#define JOURNAL_OP_MAX 16
+
+void journal_init (bool format);
+disk_sector_t journal_start (void);
+void journal_begin (void);
+void journal_end (void);
+bool journal_restart (void);
+bool journal_in_operation (void);
+bool journal_reserve (size_t cnt);
+void journal_map_dirty (size_t cnt);
+void journal_map_clean (size_t cnt);
+void journal_revoke (disk_sector_t, size_t cnt);
+uint64_t journal_log (disk_sector_t, const void *);
+bool journal_committed (uint64_t txn);
+void journal_commit (void);
+void journal_request_commit (void);
+void journal_close (void);
+void journal_mark (disk_sector_t, size_t cnt);
+bool journal_was_clean (void);
+disk_sector_t journal_region_sectors (void);
+bool journal_region_dirty (disk_sector_t);
+void journal_regions_clear (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
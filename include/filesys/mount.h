@@ -0,0 +1,59 @@
+#ifndef FILESYS_MOUNT_H
+#define FILESYS_MOUNT_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+#include "filesys/directory.h"
+
+/* Sector numbers above the disk layer name a sector of a mounted
+ * file system: the index of its mount in the top MOUNT_ID_BITS
+ * bits, and the sector on the mount's disk in the others.  The
+ * root file system is mount 0, so its sector numbers are plain disk
+ * sector numbers.  What is stored on disk never carries a mount
+ * index. */
+#define MOUNT_ID_BITS 4
+#define MOUNT_SECTOR_BITS (32 - MOUNT_ID_BITS)
+#define MOUNT_MAX (1 << MOUNT_ID_BITS)
+
+struct free_map;
+
+/* A mounted file system. */
+struct mount {
+	int id;                             /* Mount index. */
+	bool in_use;                        /* Slot taken? */
+	struct disk *disk;                  /* Disk holding the file system. */
+	char name[NAME_MAX + 1];            /* Mount point in the root
+	                                       directory, or "" for the root. */
+	struct free_map *free_map;          /* Allocator, owned by free-map.c. */
+};
+
+/* Returns the index of the mount that SECTOR belongs to. */
+static inline int
+mount_id (disk_sector_t sector) {
+	return sector >> MOUNT_SECTOR_BITS;
+}
+
+/* Returns the sector on its mount's disk that SECTOR names. */
+static inline disk_sector_t
+mount_disk_sector (disk_sector_t sector) {
+	return sector & ((1u << MOUNT_SECTOR_BITS) - 1);
+}
+
+/* Returns the sector number for DISK_SECTOR of mount ID. */
+static inline disk_sector_t
+mount_sector (int id, disk_sector_t disk_sector) {
+	return (disk_sector_t) id << MOUNT_SECTOR_BITS | disk_sector;
+}
+
+void mount_init (struct disk *root);
+struct mount *mount_get (int id);
+bool mount_used (int id);
+struct mount *mount_of (disk_sector_t);
+struct disk *mount_disk (disk_sector_t);
+void mount_lock (void);
+void mount_unlock (void);
+int mount_find (const char *name);
+int mount_add (const char *name, struct disk *);
+void mount_remove (int id);
+
+#endif /* filesys/mount.h */
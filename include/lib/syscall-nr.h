@@ -36,6 +36,11 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	SYS_GETDENTS,               /* Reads many directory entries at once. */
+	SYS_GETPID,                 /* Returns the current process id. */
+	SYS_URING_SETUP,            /* Sets up submission/completion rings. */
+	SYS_URING_ENTER,            /* Processes queued ring requests. */
 };
 
 #endif /* lib/syscall-nr.h */
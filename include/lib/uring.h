@@ -0,0 +1,62 @@
+#ifndef __LIB_URING_H
+#define __LIB_URING_H
+
+#include <stdint.h>
+
+/* Submission and completion rings for batched system calls, kept
+   in one page of a process's memory that it shares with the kernel.
+
+   The process fills in sq[sq_tail % URING_ENTRIES], increments
+   sq_tail, and calls uring_enter(), unless a kernel poller picks up
+   the request on its own.  The kernel consumes requests at sq_head
+   and posts a completion for each at cq_tail, which the process
+   consumes at cq_head.  The indexes only ever increase. */
+
+/* Entries in each ring. */
+#define URING_ENTRIES 64
+
+/* Requests. */
+enum uring_op {
+	URING_READ,                 /* read (FD, ADDR, LEN). */
+	URING_WRITE,                /* write (FD, ADDR, LEN). */
+	URING_OPEN,                 /* open (ADDR). */
+	URING_CLOSE,                /* close (FD). */
+	URING_SEEK,                 /* seek (FD, LEN). */
+};
+
+/* A submission queue entry. */
+struct uring_sqe {
+	uint32_t op;                        /* An enum uring_op. */
+	int32_t fd;                         /* File descriptor. */
+	uint64_t addr;                      /* Buffer or file name. */
+	uint64_t len;                       /* Buffer size or position. */
+	uint64_t user_data;                 /* Passed back in the completion. */
+};
+
+/* A completion queue entry. */
+struct uring_cqe {
+	uint64_t user_data;                 /* From the request. */
+	int64_t res;                        /* Result of the system call. */
+};
+
+/* uring_setup() flags. */
+#define URING_SETUP_POLL 0x1    /* A kernel thread polls for requests. */
+
+/* Flags set by the kernel in struct uring. */
+#define URING_NEED_WAKEUP 0x1   /* The poller is asleep. */
+
+/* uring_enter() flags. */
+#define URING_ENTER_WAKEUP 0x1  /* Wake the poller. */
+
+/* The shared page. */
+struct uring {
+	volatile uint32_t sq_head;          /* Next request for the kernel. */
+	volatile uint32_t sq_tail;          /* Next free request slot. */
+	volatile uint32_t cq_head;          /* Next completion for the process. */
+	volatile uint32_t cq_tail;          /* Next free completion slot. */
+	volatile uint32_t flags;            /* URING_NEED_WAKEUP. */
+	struct uring_sqe sq[URING_ENTRIES];
+	struct uring_cqe cq[URING_ENTRIES];
+} __attribute__ ((aligned (4096)));
+
+#endif /* lib/uring.h */
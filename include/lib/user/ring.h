@@ -0,0 +1,17 @@
+#ifndef __LIB_USER_RING_H
+#define __LIB_USER_RING_H
+
+#include <stdbool.h>
+#include <uring.h>
+
+/* Batched system calls through the process's submission and
+   completion rings.  See lib/uring.h. */
+
+bool ring_init (unsigned flags);
+struct uring_sqe *ring_get_sqe (void);
+void ring_queue (void);
+int ring_submit (unsigned min_complete);
+struct uring_cqe *ring_peek_cqe (void);
+void ring_cqe_seen (void);
+
+#endif /* lib/user/ring.h */
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <dirent.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -37,6 +38,9 @@ unsigned tell (int fd);
 void close (int fd);
 
 int dup2(int oldfd, int newfd);
+pid_t getpid (void);
+int uring_setup (void *ring, unsigned flags);
+int uring_enter (unsigned to_submit, unsigned min_complete, unsigned flags);
 
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
@@ -49,6 +53,7 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
+int getdents (int fd, struct dirent *, size_t size);
 
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
@@ -0,0 +1,24 @@
+#ifndef __LIB_USER_VDSO_H
+#define __LIB_USER_VDSO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vdata.h>
+
+/* System statistics read from the kernel data pages. */
+struct vdso_stats {
+	int64_t ticks;                      /* Timer ticks since boot. */
+	int64_t idle_ticks;                 /* Ticks spent idle. */
+	int64_t kernel_ticks;               /* Ticks in kernel threads. */
+	int64_t user_ticks;                 /* Ticks in user programs. */
+	int ready_cnt;                      /* Threads ready to run. */
+	int load_avg;                       /* 100 times the load average. */
+};
+
+bool vdso_available (void);
+int64_t vdso_ticks (void);
+int vdso_timer_freq (void);
+int vdso_getpid (void);
+void vdso_stats (struct vdso_stats *);
+
+#endif /* lib/user/vdso.h */
@@ -0,0 +1,43 @@
+#ifndef __LIB_VDATA_H
+#define __LIB_VDATA_H
+
+#include <stdint.h>
+
+/* Read-only pages of kernel data mapped into every process, so
+   that it can read them without a system call.
+
+   The first page, at VDATA_ADDR, is shared by all processes and
+   updated by the kernel on every timer tick.  The kernel makes SEQ
+   odd while it writes it, so a reader must retry while SEQ is odd
+   or changed during the read.  The second, at VDATA_PROC_ADDR, is
+   private to the process and never changes.
+
+   VERSION is VDATA_VERSION for this layout.  Fields are only ever
+   added at the end, with a new version. */
+
+#define VDATA_VERSION 1
+
+/* User addresses of the pages, well below the stack. */
+#define VDATA_ADDR 0x46480000
+#define VDATA_PROC_ADDR (VDATA_ADDR + 0x1000)
+
+/* The shared page. */
+struct vdata {
+	volatile uint32_t seq;              /* Odd while being written. */
+	uint32_t version;                   /* VDATA_VERSION. */
+	int32_t timer_freq;                 /* Timer ticks per second. */
+	volatile int32_t ready_cnt;         /* Threads ready to run. */
+	volatile int64_t ticks;             /* Timer ticks since boot. */
+	volatile int64_t idle_ticks;        /* Ticks spent idle. */
+	volatile int64_t kernel_ticks;      /* Ticks in kernel threads. */
+	volatile int64_t user_ticks;        /* Ticks in user programs. */
+	volatile int32_t load_avg;          /* 100 times the load average. */
+};
+
+/* The page private to a process. */
+struct vdata_proc {
+	uint32_t version;                   /* VDATA_VERSION. */
+	int32_t pid;                        /* Process id. */
+};
+
+#endif /* lib/vdata.h */
@@ -41,6 +41,23 @@ void cond_wait(struct condition *, struct lock *);
 void cond_signal(struct condition *, struct lock *);
 void cond_broadcast(struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+{
+	struct lock lock;							/* Protects the members below. */
+	struct condition readers_ok; /* Signaled when readers may enter. */
+	struct condition writer_ok;	/* Signaled when a writer may enter. */
+	int reader_cnt;								/* Readers holding the lock. */
+	int writer_waiting_cnt;				/* Writers waiting for the lock. */
+	bool writer;									/* Held by a writer? */
+};
+
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+
 // 새로운 함수
 bool sema_compare_priority(const struct list_elem *a, const struct list_elem *b, void *aux);
 /* Optimization barrier.
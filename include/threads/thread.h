@@ -107,11 +107,23 @@ struct thread
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4; /* Page map level 4 */
+
+	/* Owned by userprog/syscall.c. */
+	struct fd_table *fd_table; /* Open files and directories, or null. */
+	bool ring_request; /* Carrying out a uring request? */
+
+	/* Owned by userprog/uring.c. */
+	struct uring_ctx *uring; /* Submission/completion rings, or null. */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
 #endif
+#ifdef FILESYS
+	/* Owned by filesys/journal.c. */
+	int journal_depth; /* Nesting of journal_begin() calls. */
+	size_t journal_credits; /* Log sectors the operation may still add. */
+#endif
 
 	/* Owned by thread.c. */
 	struct intr_frame tf; /* Information for switching */
@@ -128,6 +140,8 @@ void thread_start(void);
 
 void thread_tick(void);
 void thread_print_stats(void);
+void thread_get_ticks(long long *idle, long long *kernel, long long *user);
+int thread_ready_cnt(void);
 
 typedef void thread_func(void *aux);
 tid_t thread_create(const char *name, int priority, thread_func *, void *);
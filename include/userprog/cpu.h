@@ -0,0 +1,27 @@
+#ifndef USERPROG_CPU_H
+#define USERPROG_CPU_H
+
+/* Number of CPUs with per-CPU data.  Pintos runs on one. */
+#define CPU_MAX 1
+
+/* Offsets of the members of struct cpu, for syscall-entry.S. */
+#define CPU_USER_RSP 0
+#define CPU_TSS 8
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+/* Data private to one CPU.  syscall_entry reaches the running CPU's
+ * through %gs after swapgs, since MSR_KERNEL_GS_BASE points to it, so
+ * the system call path shares no scratch space between CPUs. */
+struct cpu {
+	uint64_t user_rsp;                  /* User rsp, during syscall entry. */
+	struct task_state *tss;             /* This CPU's TSS. */
+	int id;                             /* CPU number. */
+};
+
+void cpu_init (void);
+struct cpu *cpu_current (void);
+#endif
+
+#endif /* userprog/cpu.h */
@@ -1,6 +1,16 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Longest path accepted from user programs, with its null
+ * terminator. */
+#define PATH_MAX 128
+
 void syscall_init (void);
+void syscall_exit (void);
+bool syscall_fd_table_init (void);
+int64_t syscall_run (int nr, uint64_t a1, uint64_t a2, uint64_t a3);
 
 #endif /* userprog/syscall.h */
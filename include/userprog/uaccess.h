@@ -0,0 +1,19 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct intr_frame;
+
+bool access_ok (const void *uaddr, size_t size);
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+long strncpy_from_user (char *dst, const char *usrc, size_t size);
+bool uaccess_fixup (struct intr_frame *);
+
+bool user_mapped (uint64_t *pml4, const void *uaddr, size_t size, bool write);
+bool user_string_mapped (uint64_t *pml4, const char *ustr, size_t size);
+
+#endif /* userprog/uaccess.h */
@@ -0,0 +1,8 @@
+#ifndef USERPROG_URING_H
+#define USERPROG_URING_H
+
+int uring_setup (void *uring, unsigned flags);
+int uring_enter (unsigned to_submit, unsigned min_complete, unsigned flags);
+void uring_destroy (void);
+
+#endif /* userprog/uring.h */
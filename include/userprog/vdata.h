@@ -0,0 +1,15 @@
+#ifndef USERPROG_VDATA_H
+#define USERPROG_VDATA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+void vdata_init (void);
+void vdata_tick (int64_t ticks);
+bool vdata_map (struct thread *);
+void vdata_unmap (struct thread *);
+bool vdata_overlaps (const void *uaddr, size_t size);
+
+#endif /* userprog/vdata.h */
@@ -1,6 +1,7 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -24,6 +25,10 @@ enum vm_type {
 	VM_MARKER_END = (1 << 31),
 };
 
+/* Marks a page that the kernel maps itself, such as a kernel data
+ * page.  It has no frame and is never swapped. */
+#define VM_SPECIAL VM_MARKER_1
+
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
@@ -46,6 +51,7 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	bool accessed;         /* Referenced since the last clock sweep? */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -63,6 +69,9 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list_elem elem;  /* Element in the frame table. */
+	bool busy;              /* Being evicted or freed? */
+	bool pinned;            /* Kept in memory by vm_pin_page()? */
 };
 
 /* The function table for page operations.
@@ -98,6 +107,11 @@ bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
 void vm_init (void);
+bool vm_try_free_frame (struct frame *frame);
+bool vm_register_special_page (struct supplemental_page_table *spt,
+		void *va);
+bool vm_pin_page (void *va);
+void vm_unpin_page (void *va);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -0,0 +1,71 @@
+#include <ring.h>
+#include <syscall.h>
+
+/* The page shared with the kernel. */
+static struct uring ring;
+
+/* Flags the rings were set up with. */
+static unsigned ring_flags;
+
+/* Compiler barrier between filling in an entry and publishing
+   it. */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Sets up the process's rings with FLAGS, URING_SETUP_POLL for a
+   kernel poller.  Returns true if successful. */
+bool
+ring_init (unsigned flags) {
+	ring_flags = flags;
+	return uring_setup (&ring, flags) == 0;
+}
+
+/* Returns the next free submission entry, to be filled in and
+   then queued by ring_queue(), or a null pointer if the submission
+   ring is full. */
+struct uring_sqe *
+ring_get_sqe (void) {
+	if (ring.sq_tail - ring.sq_head == URING_ENTRIES)
+		return NULL;
+	return &ring.sq[ring.sq_tail % URING_ENTRIES];
+}
+
+/* Queues the entry returned by ring_get_sqe(). */
+void
+ring_queue (void) {
+	barrier ();
+	ring.sq_tail++;
+}
+
+/* Has the kernel carry out the queued requests, and waits until
+   MIN_COMPLETE completions are ready.  With a poller that is awake
+   and nothing to wait for, does not enter the kernel at all.
+   Returns what uring_enter() returns, or 0. */
+int
+ring_submit (unsigned min_complete) {
+	unsigned flags = 0;
+
+	if (ring_flags & URING_SETUP_POLL) {
+		if (ring.flags & URING_NEED_WAKEUP)
+			flags |= URING_ENTER_WAKEUP;
+		else if (min_complete == 0)
+			return 0;
+	}
+	return uring_enter (ring.sq_tail - ring.sq_head, min_complete, flags);
+}
+
+/* Returns the oldest completion not yet seen, or a null pointer if
+   there is none. */
+struct uring_cqe *
+ring_peek_cqe (void) {
+	if (ring.cq_head == ring.cq_tail)
+		return NULL;
+	barrier ();
+	return &ring.cq[ring.cq_head % URING_ENTRIES];
+}
+
+/* Marks the completion returned by ring_peek_cqe() as seen,
+   freeing its slot. */
+void
+ring_cqe_seen (void) {
+	ring.cq_head++;
+}
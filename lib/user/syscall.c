@@ -145,6 +145,21 @@ dup2 (int oldfd, int newfd){
 	return syscall2 (SYS_DUP2, oldfd, newfd);
 }
 
+pid_t
+getpid (void) {
+	return syscall0 (SYS_GETPID);
+}
+
+int
+uring_setup (void *ring, unsigned flags) {
+	return syscall2 (SYS_URING_SETUP, ring, flags);
+}
+
+int
+uring_enter (unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return syscall3 (SYS_URING_ENTER, to_submit, min_complete, flags);
+}
+
 void *
 mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	return (void *) syscall5 (SYS_MMAP, addr, length, writable, fd, offset);
@@ -185,6 +200,11 @@ symlink (const char* target, const char* linkpath) {
 	return syscall2 (SYS_SYMLINK, target, linkpath);
 }
 
+int
+getdents (int fd, struct dirent *ents, size_t size) {
+	return syscall3 (SYS_GETDENTS, fd, ents, size);
+}
+
 int
 mount (const char *path, int chan_no, int dev_no) {
 	return syscall3 (SYS_MOUNT, path, chan_no, dev_no);
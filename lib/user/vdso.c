@@ -0,0 +1,55 @@
+#include <vdso.h>
+
+/* The kernel data pages.  See lib/vdata.h. */
+#define vdata ((const struct vdata *) VDATA_ADDR)
+#define vdata_proc ((const struct vdata_proc *) VDATA_PROC_ADDR)
+
+/* Compiler barrier, so that the reads of the shared page stay
+   between the reads of its sequence number. */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Returns true if the kernel maps data pages of the layout this
+   library knows. */
+bool
+vdso_available (void) {
+	return vdata->version == VDATA_VERSION
+		&& vdata_proc->version == VDATA_VERSION;
+}
+
+/* Returns the number of timer ticks since the OS booted. */
+int64_t
+vdso_ticks (void) {
+	/* A 64-bit load does not tear, so no retry is needed. */
+	return vdata->ticks;
+}
+
+/* Returns the number of timer ticks per second. */
+int
+vdso_timer_freq (void) {
+	return vdata->timer_freq;
+}
+
+/* Returns the process id, as getpid() does. */
+int
+vdso_getpid (void) {
+	return vdata_proc->pid;
+}
+
+/* Stores a consistent snapshot of the system statistics in *S. */
+void
+vdso_stats (struct vdso_stats *s) {
+	uint32_t seq;
+
+	do {
+		while ((seq = vdata->seq) & 1)
+			continue;
+		barrier ();
+		s->ticks = vdata->ticks;
+		s->idle_ticks = vdata->idle_ticks;
+		s->kernel_ticks = vdata->kernel_ticks;
+		s->user_ticks = vdata->user_ticks;
+		s->ready_cnt = vdata->ready_cnt;
+		s->load_avg = vdata->load_avg;
+		barrier ();
+	} while (vdata->seq != seq);
+}
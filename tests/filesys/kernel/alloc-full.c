@@ -0,0 +1,118 @@
+/* Fills the disk with 64 kB files, removes them all and fills it
+   again.  The second fill must fit at least as many files as the
+   first, or the allocator lost track of free space.  After each
+   fill, checks the start and end of every complete file. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_SIZE (64 * 1024)
+
+static unsigned char buf[4096];
+
+/* Returns the byte expected at offset OFS of file I. */
+static unsigned char
+byte_at (int i, off_t ofs)
+{
+  return (ofs / 512 * 31 + i * 7 + ofs) % 256;
+}
+
+static void
+name_of (char name[NAME_MAX + 1], int i)
+{
+  snprintf (name, NAME_MAX + 1, "full%d", i);
+}
+
+/* Checks SIZE bytes of file I, open as FILE, at OFS. */
+static void
+read_check (struct file *file, int i, off_t ofs, off_t size)
+{
+  off_t j;
+
+  if (file_read_at (file, buf, size, ofs) != size)
+    fail ("short read of full%d at %d", i, (int) ofs);
+  for (j = 0; j < size; j++)
+    if (buf[j] != byte_at (i, ofs + j))
+      fail ("byte %d of full%d differs", (int) (ofs + j), i);
+}
+
+/* Writes files until the disk is full.  Returns the number of
+   files written completely; one more may be partly written. */
+static int
+fill (void)
+{
+  char name[NAME_MAX + 1];
+  int i;
+
+  for (i = 0; ; i++)
+    {
+      struct file *file;
+      off_t ofs, j;
+
+      name_of (name, i);
+      if (!filesys_create (name, 0))
+        return i;
+      if ((file = filesys_open (name)) == NULL)
+        fail ("open \"%s\" failed", name);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+        {
+          for (j = 0; j < (off_t) sizeof buf; j++)
+            buf[j] = byte_at (i, ofs + j);
+          if (file_write (file, buf, sizeof buf) != sizeof buf)
+            {
+              file_close (file);
+              return i;
+            }
+        }
+      file_close (file);
+    }
+}
+
+/* Checks the CNT complete files, then removes them and the
+   partial one, if any. */
+static void
+check_and_remove (int cnt)
+{
+  char name[NAME_MAX + 1];
+  int i;
+
+  for (i = 0; i <= cnt; i++)
+    {
+      name_of (name, i);
+      if (i < cnt)
+        {
+          struct file *file = filesys_open (name);
+
+          if (file == NULL)
+            fail ("open \"%s\" failed", name);
+          if (file_length (file) != FILE_SIZE)
+            fail ("\"%s\" is %d bytes", name, (int) file_length (file));
+          read_check (file, i, 0, 512);
+          read_check (file, i, FILE_SIZE - 512, 512);
+          file_close (file);
+        }
+      if (!filesys_remove (name) && i < cnt)
+        fail ("remove \"%s\" failed", name);
+    }
+}
+
+void
+test_alloc_full (void) 
+{
+  int first, second;
+
+  first = fill ();
+  if (first == 0)
+    fail ("no file fit on the disk");
+  check_and_remove (first);
+  msg ("filled the disk");
+
+  second = fill ();
+  check_and_remove (second);
+  if (second < first)
+    fail ("refill fit %d files instead of %d", second, first);
+  msg ("refilled the disk with at least as many files");
+}
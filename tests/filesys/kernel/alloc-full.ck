@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alloc-full) begin
+(alloc-full) filled the disk
+(alloc-full) refilled the disk with at least as many files
+(alloc-full) end
+EOF
+pass;
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alloc-persist-persistence) begin
+(alloc-persist-persistence) files of the first boot are intact
+(alloc-persist-persistence) new files did not overwrite old ones
+(alloc-persist-persistence) end
+EOF
+pass;
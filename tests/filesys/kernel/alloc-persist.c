@@ -0,0 +1,151 @@
+/* Writes files and removes some of them, then shuts down.
+   alloc-persist-persistence boots again from the same disk and
+   writes more files, which must not be given space that the
+   first boot's files still use: the allocation state has to have
+   reached the disk.  Then it checks both sets of files.
+
+   alloc-replay does the same, but commits the journal, writes
+   the cache back and crashes instead of shutting down, so that
+   the allocation state comes back through the journal. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "tests/filesys/kernel/crash.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+
+#define FILE_CNT 30
+#define FILE_SIZE 8192
+
+static unsigned char buf[FILE_SIZE];
+
+/* Fills BUF with the contents of file number I. */
+static void
+fill_buf (int i)
+{
+  size_t j;
+
+  for (j = 0; j < sizeof buf; j++)
+    buf[j] = (j / 512 * 31 + i * 7 + j) % 256;
+}
+
+/* Returns true if file number I of the first boot was removed. */
+static bool
+removed (int i)
+{
+  return i % 3 == 0;
+}
+
+/* Creates file PREFIX followed by I with the contents of file
+   number I. */
+static void
+write_file (const char *prefix, int i)
+{
+  char name[NAME_MAX + 1];
+  struct file *file;
+
+  snprintf (name, sizeof name, "%s%d", prefix, i);
+  if (!filesys_create (name, 0) || (file = filesys_open (name)) == NULL)
+    fail ("create \"%s\" failed", name);
+  fill_buf (i);
+  if (file_write (file, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("write to \"%s\" failed", name);
+  file_close (file);
+}
+
+/* Checks that file PREFIX followed by I has the contents of file
+   number I. */
+static void
+check_file (const char *prefix, int i)
+{
+  static unsigned char data[FILE_SIZE];
+  char name[NAME_MAX + 1];
+  struct file *file;
+
+  snprintf (name, sizeof name, "%s%d", prefix, i);
+  if ((file = filesys_open (name)) == NULL)
+    fail ("open \"%s\" failed", name);
+  if (file_read (file, data, FILE_SIZE) != FILE_SIZE)
+    fail ("short read of \"%s\"", name);
+  fill_buf (i);
+  if (memcmp (data, buf, FILE_SIZE))
+    fail ("\"%s\" differs", name);
+  file_close (file);
+}
+
+/* Writes the first boot's files and removes every third one. */
+static void
+write_old (void)
+{
+  char name[NAME_MAX + 1];
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    write_file ("old", i);
+  for (i = 0; i < FILE_CNT; i++)
+    if (removed (i))
+      {
+        snprintf (name, sizeof name, "old%d", i);
+        if (!filesys_remove (name))
+          fail ("remove \"%s\" failed", name);
+      }
+}
+
+/* Writes the second boot's files, and checks them and the files
+   left by the first boot. */
+static void
+write_new (void)
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    if (!removed (i))
+      check_file ("old", i);
+  msg ("files of the first boot are intact");
+
+  for (i = 0; i < FILE_CNT; i++)
+    write_file ("new", FILE_CNT + i);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      if (!removed (i))
+        check_file ("old", i);
+      check_file ("new", FILE_CNT + i);
+    }
+  msg ("new files did not overwrite old ones");
+}
+
+void
+test_alloc_persist (void) 
+{
+  write_old ();
+  msg ("wrote %d files and removed %d", FILE_CNT, FILE_CNT / 3);
+}
+
+void
+test_alloc_persist_persistence (void) 
+{
+  write_new ();
+}
+
+void
+test_alloc_replay (void) 
+{
+  write_old ();
+  journal_commit ();
+  buffer_cache_flush ();
+  msg ("crash with %d files written and %d removed", FILE_CNT,
+       FILE_CNT / 3);
+  crash ();
+}
+
+void
+test_alloc_replay_persistence (void) 
+{
+  if (journal_was_clean ())
+    fail ("file system was shut down cleanly");
+  write_new ();
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alloc-persist) begin
+(alloc-persist) wrote 30 files and removed 10
+(alloc-persist) end
+EOF
+pass;
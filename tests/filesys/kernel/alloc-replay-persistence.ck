@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alloc-replay-persistence) begin
+(alloc-replay-persistence) files of the first boot are intact
+(alloc-replay-persistence) new files did not overwrite old ones
+(alloc-replay-persistence) end
+EOF
+pass;
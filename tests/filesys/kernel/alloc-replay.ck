@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(alloc-replay) begin', @output);
+fail "didn't crash after committing\n"
+  if !grep ($_ eq '(alloc-replay) crash with 30 files written and 10 removed',
+            @output);
+pass;
@@ -0,0 +1,76 @@
+/* Measures the latency of opening and closing a file, in cycles
+   per open/close pair, while thousands of other files are held
+   open: once for a file that is already open, which only takes
+   the inode hash table's stripe lock, and once for a file that is
+   not, which also reads its inode.  Not a graded test: the
+   numbers depend on the host. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+
+#define HELD_CNT 2000           /* Files held open throughout. */
+#define COLD_CNT 200            /* Files opened one at a time. */
+#define ITERATIONS 20000
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t) hi << 32 | lo;
+}
+
+static struct file *
+open_nth (int i)
+{
+  char name[16];
+  struct file *file;
+
+  snprintf (name, sizeof name, "f%d", i);
+  file = filesys_open (name);
+  if (file == NULL)
+    fail ("open \"%s\" failed", name);
+  return file;
+}
+
+void
+test_bench_inode_open (void) 
+{
+  struct file **held;
+  uint64_t start;
+  char name[16];
+  int i;
+
+  held = malloc (HELD_CNT * sizeof *held);
+  if (held == NULL)
+    fail ("out of memory");
+  for (i = 0; i < HELD_CNT + COLD_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!filesys_create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  for (i = 0; i < HELD_CNT; i++)
+    held[i] = open_nth (i);
+  msg ("holding %d files open", HELD_CNT);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    file_close (open_nth (i % HELD_CNT));
+  msg ("open/close of an open file: %llu cycles",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    file_close (open_nth (HELD_CNT + i % COLD_CNT));
+  msg ("open/close of a closed file: %llu cycles",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+
+  for (i = 0; i < HELD_CNT; i++)
+    file_close (held[i]);
+  free (held);
+}
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_KERNEL_CRASH_H
+#define TESTS_FILESYS_KERNEL_CRASH_H
+
+#include <debug.h>
+
+void crash (void) NO_RETURN;
+
+#endif /* tests/filesys/kernel/crash.h */
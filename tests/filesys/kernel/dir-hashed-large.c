@@ -0,0 +1,85 @@
+/* Creates 2000 files in the root directory, enough to double its
+   bucket table several times, then removes every other one and
+   checks that lookups, duplicate checks and a full listing see
+   exactly the files that remain. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_CNT 2000
+
+static void
+name_of (char name[NAME_MAX + 1], int i)
+{
+  snprintf (name, NAME_MAX + 1, "file%d", i);
+}
+
+/* Returns true if the file numbered I can be opened. */
+static bool
+exists (int i)
+{
+  char name[NAME_MAX + 1];
+  struct file *file;
+
+  name_of (name, i);
+  file = filesys_open (name);
+  if (file == NULL)
+    return false;
+  file_close (file);
+  return true;
+}
+
+void
+test_dir_hashed_large (void) 
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  int i, cnt;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      name_of (name, i);
+      if (!filesys_create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i++)
+    if (!exists (i))
+      fail ("file%d not found", i);
+  for (i = 0; i < FILE_CNT; i += 97)
+    {
+      name_of (name, i);
+      if (filesys_create (name, 0))
+        fail ("second create of \"%s\" succeeded", name);
+    }
+  msg ("found every file");
+
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      name_of (name, i);
+      if (!filesys_remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  for (i = 0; i < FILE_CNT; i++)
+    if (exists (i) != (i % 2 == 1))
+      fail ("file%d %s after removing the even files", i,
+            i % 2 ? "missing" : "still present");
+  msg ("removed every other file");
+
+  dir = dir_open_root ();
+  if (dir == NULL)
+    fail ("open root failed");
+  for (cnt = 0; dir_readdir (dir, name); cnt++)
+    if (memcmp (name, "file", 4) || atoi (name + 4) % 2 != 1)
+      fail ("unexpected entry \"%s\"", name);
+  dir_close (dir);
+  if (cnt != FILE_CNT / 2)
+    fail ("listed %d entries instead of %d", cnt, FILE_CNT / 2);
+  msg ("listed %d files", cnt);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-hashed-large) begin
+(dir-hashed-large) created 2000 files
+(dir-hashed-large) found every file
+(dir-hashed-large) removed every other file
+(dir-hashed-large) listed 1000 files
+(dir-hashed-large) end
+EOF
+pass;
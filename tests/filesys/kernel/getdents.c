@@ -0,0 +1,99 @@
+/* Lists a directory of 300 files with dir_readdir_batch(), the
+   body of the getdents system call, a few entries at a time, and
+   checks that each file is returned exactly once with its inode
+   number and type.  Then checks that dir_readdir() and
+   dir_readdir_batch() share the directory position. */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+
+#define FILE_CNT 300
+#define BATCH 7
+
+/* Returns the number of the file named NAME, or -1 if NAME is
+   not one of the test's files. */
+static int
+number_of (const char *name)
+{
+  int i;
+
+  if (name[0] != 'g')
+    return -1;
+  i = atoi (name + 1);
+  return i >= 0 && i < FILE_CNT ? i : -1;
+}
+
+void
+test_getdents (void) 
+{
+  static disk_sector_t inumbers[FILE_CNT];
+  static bool seen[FILE_CNT];
+  struct dirent ents[BATCH];
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  size_t n, j;
+  int i, cnt;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      struct file *file;
+
+      snprintf (name, sizeof name, "g%d", i);
+      if (!filesys_create (name, 0) || (file = filesys_open (name)) == NULL)
+        fail ("create \"%s\" failed", name);
+      inumbers[i] = inode_get_inumber (file_get_inode (file));
+      file_close (file);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  dir = dir_open_root ();
+  if (dir == NULL)
+    fail ("open root failed");
+  cnt = 0;
+  while ((n = dir_readdir_batch (dir, ents, BATCH)) > 0)
+    for (j = 0; j < n; j++)
+      {
+        i = number_of (ents[j].d_name);
+        if (i < 0)
+          fail ("unexpected entry \"%s\"", ents[j].d_name);
+        if (seen[i])
+          fail ("\"%s\" listed twice", ents[j].d_name);
+        if (ents[j].d_ino != inumbers[i])
+          fail ("\"%s\" has inode %u instead of %u", ents[j].d_name,
+                (unsigned) ents[j].d_ino, (unsigned) inumbers[i]);
+        if (ents[j].d_type != DT_REG)
+          fail ("\"%s\" has type %d", ents[j].d_name, ents[j].d_type);
+        seen[i] = true;
+        cnt++;
+      }
+  if (cnt != FILE_CNT)
+    fail ("listed %d entries instead of %d", cnt, FILE_CNT);
+  if (dir_readdir_batch (dir, ents, BATCH) != 0 || dir_readdir (dir, name))
+    fail ("entries past the end of the directory");
+  dir_close (dir);
+  msg ("listed every file once");
+
+  dir = dir_open_root ();
+  if (dir == NULL)
+    fail ("open root failed");
+  cnt = 0;
+  for (;;)
+    {
+      n = dir_readdir_batch (dir, ents, BATCH);
+      cnt += n;
+      if (n == 0 || !dir_readdir (dir, name))
+        break;
+      cnt++;
+    }
+  dir_close (dir);
+  if (cnt != FILE_CNT)
+    fail ("mixed listing saw %d entries instead of %d", cnt, FILE_CNT);
+  msg ("mixed listing saw every file");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents) begin
+(getdents) created 300 files
+(getdents) listed every file once
+(getdents) mixed listing saw every file
+(getdents) end
+EOF
+pass;
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(journal-replay-persistence) begin
+(journal-replay-persistence) found 50 files after replay
+(journal-replay-persistence) created a file after replay
+(journal-replay-persistence) end
+EOF
+pass;
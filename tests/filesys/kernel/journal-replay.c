@@ -0,0 +1,74 @@
+/* Makes metadata changes, commits them to the journal and powers
+   off without shutting down the file system, as if the machine had
+   lost power.  journal-replay-persistence then boots from the same
+   disk, without formatting it, and checks that the journal brought
+   back every committed change. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "tests/filesys/kernel/crash.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+
+#define FILE_CNT 50
+#define FILE_SIZE 1000
+
+static void
+name_of (char name[16], int i)
+{
+  snprintf (name, 16, "kept%d", i);
+}
+
+void
+test_journal_replay (void) 
+{
+  static char zeros[FILE_SIZE];
+  char name[16];
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      struct file *file;
+
+      name_of (name, i);
+      if (!filesys_create (name, 0) || (file = filesys_open (name)) == NULL)
+        fail ("create \"%s\" failed", name);
+      if (file_write (file, zeros, FILE_SIZE) != FILE_SIZE)
+        fail ("write to \"%s\" failed", name);
+      file_close (file);
+    }
+  if (!filesys_create ("removed", FILE_SIZE) || !filesys_remove ("removed"))
+    fail ("create and remove of \"removed\" failed");
+  journal_commit ();
+  msg ("crash with %d files committed", FILE_CNT);
+  crash ();
+}
+
+void
+test_journal_replay_persistence (void) 
+{
+  char name[16];
+  struct file *file;
+  int i;
+
+  if (journal_was_clean ())
+    fail ("file system was shut down cleanly");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      name_of (name, i);
+      if ((file = filesys_open (name)) == NULL)
+        fail ("\"%s\" lost", name);
+      if (file_length (file) != FILE_SIZE)
+        fail ("\"%s\" is %d bytes instead of %d", name,
+              (int) file_length (file), FILE_SIZE);
+      file_close (file);
+    }
+  if ((file = filesys_open ("removed")) != NULL)
+    fail ("\"removed\" came back");
+  msg ("found %d files after replay", FILE_CNT);
+
+  if (!filesys_create ("after", FILE_SIZE))
+    fail ("create after replay failed");
+  msg ("created a file after replay");
+}
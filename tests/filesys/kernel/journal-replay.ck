@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(journal-replay) begin', @output);
+fail "didn't crash after committing\n"
+  if !grep ($_ eq '(journal-replay) crash with 50 files committed', @output);
+pass;
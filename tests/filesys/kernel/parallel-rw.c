@@ -0,0 +1,114 @@
+/* Runs four threads at once.  Each one rewrites its own file and
+   reads it back, over and over, and reads a file that all of them
+   share in between, checking every byte it reads. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4
+#define ROUND_CNT 10
+#define FILE_SIZE 16384
+
+/* Fills BUF with the contents of version ROUND of file I. */
+static void
+fill_buf (unsigned char *buf, int i, int round)
+{
+  size_t j;
+
+  for (j = 0; j < FILE_SIZE; j++)
+    buf[j] = (j / 512 * 31 + i * 7 + round * 13 + j) % 256;
+}
+
+/* Reads all of FILE and checks that it is version ROUND of file
+   I.  EXPECTED and DATA are scratch buffers. */
+static void
+read_check (struct file *file, int i, int round, unsigned char *expected,
+            unsigned char *data)
+{
+  if (file_read_at (file, data, FILE_SIZE, 0) != FILE_SIZE)
+    fail ("short read of file %d", i);
+  fill_buf (expected, i, round);
+  if (memcmp (data, expected, FILE_SIZE))
+    fail ("file %d is not version %d", i, round);
+}
+
+struct worker
+  {
+    int id;
+    struct file *shared;            /* Opened by this worker. */
+    struct semaphore done;
+  };
+
+static void
+worker_func (void *w_)
+{
+  struct worker *w = w_;
+  unsigned char *expected = malloc (FILE_SIZE);
+  unsigned char *data = malloc (FILE_SIZE);
+  char name[NAME_MAX + 1];
+  struct file *file;
+  int round;
+
+  if (expected == NULL || data == NULL)
+    fail ("out of memory");
+  snprintf (name, sizeof name, "par%d", w->id);
+  if ((file = filesys_open (name)) == NULL)
+    fail ("open \"%s\" failed", name);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      fill_buf (expected, w->id, round);
+      if (file_write_at (file, expected, FILE_SIZE, 0) != FILE_SIZE)
+        fail ("write to \"%s\" failed", name);
+      read_check (w->shared, THREAD_CNT, 0, expected, data);
+      read_check (file, w->id, round, expected, data);
+    }
+  file_close (file);
+  free (expected);
+  free (data);
+  sema_up (&w->done);
+}
+
+void
+test_parallel_rw (void) 
+{
+  static unsigned char buf[FILE_SIZE];
+  struct worker workers[THREAD_CNT];
+  char name[NAME_MAX + 1];
+  struct file *file;
+  int i;
+
+  if (!filesys_create ("shared", 0) || (file = filesys_open ("shared")) == NULL)
+    fail ("create \"shared\" failed");
+  fill_buf (buf, THREAD_CNT, 0);
+  if (file_write (file, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("write to \"shared\" failed");
+  file_close (file);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      struct worker *w = &workers[i];
+
+      snprintf (name, sizeof name, "par%d", i);
+      if (!filesys_create (name, FILE_SIZE))
+        fail ("create \"%s\" failed", name);
+      w->id = i;
+      if ((w->shared = filesys_open ("shared")) == NULL)
+        fail ("open \"shared\" failed");
+      sema_init (&w->done, 0);
+      snprintf (name, sizeof name, "worker %d", i);
+      thread_create (name, PRI_DEFAULT, worker_func, w);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      sema_down (&workers[i].done);
+      file_close (workers[i].shared);
+    }
+  msg ("%d threads read and wrote %d rounds each", THREAD_CNT, ROUND_CNT);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(parallel-rw) begin
+(parallel-rw) 4 threads read and wrote 10 rounds each
+(parallel-rw) end
+EOF
+pass;
@@ -0,0 +1,108 @@
+/* Reads a 1 MB file at random offsets, which makes the file
+   system find the disk location of each offset from scratch or
+   from its nearest cached one, and checks every byte read.  Then
+   overwrites random ranges and checks them the same way. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define READ_CNT 2000
+#define WRITE_CNT 200
+#define MAX_SIZE 3000
+
+static unsigned char buf[4096];
+
+/* Number of times each sector of the file has been overwritten. */
+static unsigned char generations[FILE_SIZE / 512];
+
+/* Returns the byte expected at offset OFS after its sector has
+   been overwritten GENERATION times. */
+static unsigned char
+byte_at (off_t ofs, int generation)
+{
+  return (ofs + ofs / 512 * 31 + generation * 101) % 256;
+}
+
+/* Reads SIZE bytes of FILE at OFS and checks them. */
+static void
+read_check (struct file *file, off_t ofs, off_t size)
+{
+  off_t i;
+
+  if (file_read_at (file, buf, size, ofs) != size)
+    fail ("short read at %d", (int) ofs);
+  for (i = 0; i < size; i++)
+    if (buf[i] != byte_at (ofs + i, generations[(ofs + i) / 512]))
+      fail ("byte %d is %d instead of %d", (int) (ofs + i), buf[i],
+            byte_at (ofs + i, generations[(ofs + i) / 512]));
+}
+
+/* Rewrites the whole sectors from sector SECTOR up to, but not
+   including, sector END. */
+static void
+write_sectors (struct file *file, off_t sector, off_t end)
+{
+  for (; sector < end; sector++)
+    {
+      off_t i;
+
+      for (i = 0; i < 512; i++)
+        buf[i] = byte_at (sector * 512 + i, generations[sector]);
+      if (file_write_at (file, buf, 512, sector * 512) != 512)
+        fail ("write at %d failed", (int) (sector * 512));
+    }
+}
+
+/* Returns a random offset and size within the file. */
+static void
+random_range (off_t *ofs, off_t *size)
+{
+  *size = random_ulong () % MAX_SIZE + 1;
+  *ofs = random_ulong () % (FILE_SIZE - *size + 1);
+}
+
+void
+test_read_random (void) 
+{
+  struct file *file;
+  off_t ofs, size;
+  int i;
+
+  random_init (0x5eed);
+  if (!filesys_create ("random", 0)
+      || (file = filesys_open ("random")) == NULL)
+    fail ("create \"random\" failed");
+  write_sectors (file, 0, FILE_SIZE / 512);
+  msg ("wrote %d bytes", FILE_SIZE);
+
+  for (i = 0; i < READ_CNT; i++)
+    {
+      random_range (&ofs, &size);
+      read_check (file, ofs, size);
+    }
+  msg ("read %d random ranges", READ_CNT);
+
+  for (i = 0; i < WRITE_CNT; i++)
+    {
+      off_t sector, end;
+
+      random_range (&ofs, &size);
+      sector = ofs / 512;
+      end = (ofs + size + 511) / 512;
+      for (ofs = sector; ofs < end; ofs++)
+        generations[ofs]++;
+      write_sectors (file, sector, end);
+    }
+  for (i = 0; i < READ_CNT; i++)
+    {
+      random_range (&ofs, &size);
+      read_check (file, ofs, size);
+    }
+  file_close (file);
+  msg ("read %d random ranges after %d random writes", READ_CNT,
+       WRITE_CNT);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(read-random) begin
+(read-random) wrote 1048576 bytes
+(read-random) read 2000 random ranges
+(read-random) read 2000 random ranges after 200 random writes
+(read-random) end
+EOF
+pass;
@@ -0,0 +1,99 @@
+/* Reads a file sequentially, then backward, then sequentially
+   again, and with two openers of the same file taking turns, so
+   that readahead grows, shrinks and runs per opener, and checks
+   every byte read. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_SIZE 200000
+#define CHUNK 1000
+
+static unsigned char buf[4096];
+
+/* Returns the byte expected at offset OFS. */
+static unsigned char
+byte_at (off_t ofs)
+{
+  return (ofs + ofs / 512 * 31) % 256;
+}
+
+/* Reads SIZE bytes at FILE's position and checks them. */
+static void
+read_check (struct file *file, off_t size)
+{
+  off_t ofs = file_tell (file);
+  off_t i;
+
+  if (file_read (file, buf, size) != size)
+    fail ("short read at %d", (int) ofs);
+  for (i = 0; i < size; i++)
+    if (buf[i] != byte_at (ofs + i))
+      fail ("byte %d is %d instead of %d", (int) (ofs + i), buf[i],
+            byte_at (ofs + i));
+}
+
+static struct file *
+open_seq (void)
+{
+  struct file *file = filesys_open ("seq");
+
+  if (file == NULL)
+    fail ("open \"seq\" failed");
+  return file;
+}
+
+void
+test_read_seq (void) 
+{
+  struct file *file, *other;
+  off_t ofs;
+
+  if (!filesys_create ("seq", 0))
+    fail ("create \"seq\" failed");
+  file = open_seq ();
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    {
+      off_t size = FILE_SIZE - ofs < (off_t) sizeof buf
+                   ? FILE_SIZE - ofs : (off_t) sizeof buf;
+      off_t i;
+
+      for (i = 0; i < size; i++)
+        buf[i] = byte_at (ofs + i);
+      if (file_write (file, buf, size) != size)
+        fail ("write at %d failed", (int) ofs);
+    }
+  file_close (file);
+  msg ("wrote %d bytes", FILE_SIZE);
+
+  file = open_seq ();
+  for (ofs = 0; ofs + CHUNK <= FILE_SIZE; ofs += CHUNK)
+    read_check (file, CHUNK);
+  if (file_read (file, buf, 1) != 0)
+    fail ("read past the end returned data");
+  msg ("read forward");
+
+  for (ofs = FILE_SIZE - CHUNK; ofs >= 0; ofs -= 7 * CHUNK)
+    {
+      file_seek (file, ofs);
+      read_check (file, 100);
+    }
+  file_seek (file, 0);
+  for (ofs = 0; ofs + CHUNK <= FILE_SIZE; ofs += CHUNK)
+    read_check (file, CHUNK);
+  msg ("read backward, then forward again");
+
+  other = open_seq ();
+  file_seek (file, 0);
+  file_seek (other, FILE_SIZE / 2);
+  for (ofs = 0; ofs + CHUNK <= FILE_SIZE / 2; ofs += CHUNK)
+    {
+      read_check (file, CHUNK);
+      read_check (other, CHUNK);
+    }
+  file_close (other);
+  file_close (file);
+  msg ("read with two openers taking turns");
+}
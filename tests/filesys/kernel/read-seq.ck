@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(read-seq) begin
+(read-seq) wrote 200000 bytes
+(read-seq) read forward
+(read-seq) read backward, then forward again
+(read-seq) read with two openers taking turns
+(read-seq) end
+EOF
+pass;
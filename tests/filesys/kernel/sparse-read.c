@@ -0,0 +1,91 @@
+/* Writes past the end of an empty file, leaving a hole, and checks
+   that the hole reads back as zeros and the data as written, both
+   while the new sectors may still be waiting for allocation and
+   after the file has been closed and opened again.  Then fills
+   part of the hole and checks the rest of it. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define HOLE 100000             /* Offset of the first data. */
+#define MIDDLE 50001            /* Offset of the second data. */
+#define DATA_SIZE 700
+
+static char data[DATA_SIZE];
+static char buf[4096];
+
+/* Checks that the SIZE bytes of FILE at OFS are zeros. */
+static void
+check_zeros (struct file *file, off_t ofs, off_t size)
+{
+  while (size > 0)
+    {
+      off_t chunk = size < (off_t) sizeof buf ? size : (off_t) sizeof buf;
+      off_t i;
+
+      if (file_read_at (file, buf, chunk, ofs) != chunk)
+        fail ("short read at %d", (int) ofs);
+      for (i = 0; i < chunk; i++)
+        if (buf[i] != 0)
+          fail ("byte %d of the hole is %d", (int) (ofs + i), buf[i]);
+      ofs += chunk;
+      size -= chunk;
+    }
+}
+
+/* Checks that the DATA_SIZE bytes of FILE at OFS are DATA. */
+static void
+check_data (struct file *file, off_t ofs)
+{
+  if (file_read_at (file, buf, DATA_SIZE, ofs) != DATA_SIZE)
+    fail ("short read at %d", (int) ofs);
+  if (memcmp (buf, data, DATA_SIZE))
+    fail ("data at %d differs", (int) ofs);
+}
+
+static void
+check_file (struct file *file)
+{
+  if (file_length (file) != HOLE + DATA_SIZE)
+    fail ("length is %d instead of %d",
+          (int) file_length (file), HOLE + DATA_SIZE);
+  check_zeros (file, 0, HOLE);
+  check_data (file, HOLE);
+  if (file_read_at (file, buf, 1, HOLE + DATA_SIZE) != 0)
+    fail ("read past the end returned data");
+}
+
+void
+test_sparse_read (void) 
+{
+  struct file *file;
+  size_t i;
+
+  for (i = 0; i < DATA_SIZE; i++)
+    data[i] = i % 251 + 1;
+
+  if (!filesys_create ("sparse", 0) || (file = filesys_open ("sparse")) == NULL)
+    fail ("create \"sparse\" failed");
+  if (file_write_at (file, data, DATA_SIZE, HOLE) != DATA_SIZE)
+    fail ("write at %d failed", HOLE);
+  check_file (file);
+  msg ("hole reads as zeros before close");
+
+  file_close (file);
+  if ((file = filesys_open ("sparse")) == NULL)
+    fail ("reopen \"sparse\" failed");
+  check_file (file);
+  msg ("hole reads as zeros after reopen");
+
+  if (file_write_at (file, data, DATA_SIZE, MIDDLE) != DATA_SIZE)
+    fail ("write at %d failed", MIDDLE);
+  check_zeros (file, 0, MIDDLE);
+  check_data (file, MIDDLE);
+  check_zeros (file, MIDDLE + DATA_SIZE, HOLE - MIDDLE - DATA_SIZE);
+  check_data (file, HOLE);
+  file_close (file);
+  msg ("rest of the hole reads as zeros");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sparse-read) begin
+(sparse-read) hole reads as zeros before close
+(sparse-read) hole reads as zeros after reopen
+(sparse-read) rest of the hole reads as zeros
+(sparse-read) end
+EOF
+pass;
@@ -38,6 +38,22 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+#ifdef FILESYS
+    {"bench-inode-open", test_bench_inode_open},
+    {"dir-hashed-large", test_dir_hashed_large},
+    {"getdents", test_getdents},
+    {"sparse-read", test_sparse_read},
+    {"journal-replay", test_journal_replay},
+    {"journal-replay-persistence", test_journal_replay_persistence},
+    {"read-seq", test_read_seq},
+    {"read-random", test_read_random},
+    {"alloc-full", test_alloc_full},
+    {"alloc-persist", test_alloc_persist},
+    {"alloc-persist-persistence", test_alloc_persist_persistence},
+    {"alloc-replay", test_alloc_replay},
+    {"alloc-replay-persistence", test_alloc_replay_persistence},
+    {"parallel-rw", test_parallel_rw},
+#endif
   };
 
 static const char *test_name;
@@ -32,6 +32,22 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+#ifdef FILESYS
+extern test_func test_bench_inode_open;
+extern test_func test_dir_hashed_large;
+extern test_func test_getdents;
+extern test_func test_sparse_read;
+extern test_func test_journal_replay;
+extern test_func test_journal_replay_persistence;
+extern test_func test_read_seq;
+extern test_func test_read_random;
+extern test_func test_alloc_full;
+extern test_func test_alloc_persist;
+extern test_func test_alloc_persist_persistence;
+extern test_func test_alloc_replay;
+extern test_func test_alloc_replay_persistence;
+extern test_func test_parallel_rw;
+#endif
 
 void msg (const char *, ...);
 void fail (const char *, ...);
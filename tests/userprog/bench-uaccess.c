@@ -0,0 +1,50 @@
+/* Measures small open, read and readdir style calls, whose cost is
+   dominated by checking and copying user memory, in cycles per
+   call.  Not a graded test: the numbers depend on the host. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERATIONS 10000
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t) hi << 32 | lo;
+}
+
+void
+test_main (void) 
+{
+  char buf[16];
+  uint64_t start;
+  int fd, i;
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    close (open (test_name));
+  msg ("open+close: %llu cycles per pair",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+
+  CHECK ((fd = open (test_name)) > 1, "open \"%s\"", test_name);
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      seek (fd, 0);
+      read (fd, buf, sizeof buf);
+    }
+  msg ("read of %d bytes: %llu cycles per call", (int) sizeof buf,
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    write (STDOUT_FILENO, buf, 0);
+  msg ("empty write: %llu cycles per call",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+  close (fd);
+}
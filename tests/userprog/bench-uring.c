@@ -0,0 +1,93 @@
+/* Does 100,000 reads of 16 bytes from a file, first with one
+   system call each, then through the submission and completion
+   rings, and reports the cycles per read.  The rings have a kernel
+   poller if the program is run as "bench-uring poll".  Not a
+   graded test: the numbers depend on the host. */
+
+#include <ring.h>
+#include <stdint.h>
+#include <syscall.h>
+#include <string.h>
+#include "tests/lib.h"
+
+#define READS 100000
+#define READ_SIZE 16
+#define BATCH 32
+
+static char buf[BATCH][READ_SIZE];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t) hi << 32 | lo;
+}
+
+/* Reads through the rings, BATCH requests at a time, rewinding FD
+   whenever it reaches the end. */
+static void
+ring_reads (int fd)
+{
+  int done = 0;
+
+  while (done < READS)
+    {
+      bool eof = false;
+      int i;
+
+      for (i = 0; i < BATCH; i++)
+        {
+          struct uring_sqe *sqe = ring_get_sqe ();
+          sqe->op = URING_READ;
+          sqe->fd = fd;
+          sqe->addr = (uint64_t) buf[i];
+          sqe->len = READ_SIZE;
+          sqe->user_data = i;
+          ring_queue ();
+        }
+      ring_submit (BATCH);
+      for (i = 0; i < BATCH; i++)
+        {
+          struct uring_cqe *cqe;
+
+          while ((cqe = ring_peek_cqe ()) == NULL)
+            ring_submit (1);
+          if (cqe->res < READ_SIZE)
+            eof = true;
+          ring_cqe_seen ();
+        }
+      if (eof)
+        seek (fd, 0);
+      done += BATCH;
+    }
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  bool poll = argc > 1 && !strcmp (argv[1], "poll");
+  uint64_t start;
+  int fd, i;
+
+  test_name = "bench-uring";
+  msg ("begin");
+  CHECK ((fd = open (test_name)) > 1, "open \"%s\"", test_name);
+
+  start = rdtsc ();
+  for (i = 0; i < READS; i++)
+    if (read (fd, buf[0], READ_SIZE) < READ_SIZE)
+      seek (fd, 0);
+  msg ("read: %llu cycles per read",
+       (unsigned long long) (rdtsc () - start) / READS);
+
+  CHECK (ring_init (poll ? URING_SETUP_POLL : 0), "set up rings");
+  seek (fd, 0);
+  start = rdtsc ();
+  ring_reads (fd);
+  msg ("ring%s, batches of %d: %llu cycles per read",
+       poll ? " with poller" : "", BATCH,
+       (unsigned long long) (rdtsc () - start) / READS);
+  msg ("end");
+  return 0;
+}
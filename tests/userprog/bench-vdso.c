@@ -0,0 +1,56 @@
+/* Compares reading the process id and the tick count from the
+   kernel data pages with asking for the process id by system call,
+   in cycles per call.  Not a graded test: the numbers depend on the
+   host. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <vdso.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERATIONS 100000
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t) hi << 32 | lo;
+}
+
+void
+test_main (void) 
+{
+  struct vdso_stats s;
+  volatile int64_t sink;
+  uint64_t start;
+  int i;
+
+  CHECK (vdso_available (), "kernel data pages present");
+  CHECK (vdso_getpid () == getpid (), "pid matches getpid()");
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    sink = getpid ();
+  msg ("getpid: %llu cycles per call",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    sink = vdso_getpid ();
+  msg ("vdso_getpid: %llu cycles per call",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    sink = vdso_ticks ();
+  msg ("vdso_ticks: %llu cycles per call",
+       (unsigned long long) (rdtsc () - start) / ITERATIONS);
+  (void) sink;
+
+  vdso_stats (&s);
+  msg ("%lld ticks at %d Hz: %lld idle, %lld kernel, %lld user",
+       (long long) s.ticks, vdso_timer_freq (), (long long) s.idle_ticks,
+       (long long) s.kernel_ticks, (long long) s.user_ticks);
+}
@@ -0,0 +1,77 @@
+/* Makes many system calls on both entry paths, fast (getpid) and
+   full (close of a bad fd), and checks after each that the kernel
+   preserved every register it must.  Timer interrupts land all
+   over the entry and exit code meanwhile, and preempt the process
+   in the middle of system calls.
+
+   This only exercises a single process.  Without fork and exec in
+   this tree, no second process can be running system calls at the
+   same time, so the test says nothing about concurrent entry from
+   several processes: the per-CPU scratch space is only checked
+   against preemption of one process by kernel threads. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERATIONS 200000
+
+/* Makes system call NR with every register that must survive it
+   set to a known value.  Returns nonzero if any of them changed. */
+static int
+call_clobbers (uint64_t nr)
+{
+  int changed;
+
+  asm volatile (
+    "movq $0x1001, %%rbx\n"
+    "movq $0x1002, %%rdi\n"
+    "movq $0x1003, %%rsi\n"
+    "movq $0x1004, %%rdx\n"
+    "movq $0x1005, %%r8\n"
+    "movq $0x1006, %%r9\n"
+    "movq $0x1007, %%r10\n"
+    "movq $0x1008, %%r12\n"
+    "movq $0x1009, %%r13\n"
+    "movq $0x100a, %%r14\n"
+    "movq $0x100b, %%r15\n"
+    "movq %1, %%rax\n"
+    "syscall\n"
+    "movl $1, %0\n"
+    "cmpq $0x1001, %%rbx\n jne 1f\n"
+    "cmpq $0x1002, %%rdi\n jne 1f\n"
+    "cmpq $0x1003, %%rsi\n jne 1f\n"
+    "cmpq $0x1004, %%rdx\n jne 1f\n"
+    "cmpq $0x1005, %%r8\n jne 1f\n"
+    "cmpq $0x1006, %%r9\n jne 1f\n"
+    "cmpq $0x1007, %%r10\n jne 1f\n"
+    "cmpq $0x1008, %%r12\n jne 1f\n"
+    "cmpq $0x1009, %%r13\n jne 1f\n"
+    "cmpq $0x100a, %%r14\n jne 1f\n"
+    "cmpq $0x100b, %%r15\n jne 1f\n"
+    "movl $0, %0\n"
+    "1:\n"
+    : "=m" (changed)
+    : "g" (nr)
+    : "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10",
+      "r11", "r12", "r13", "r14", "r15", "cc", "memory");
+  return changed;
+}
+
+void
+test_main (void) 
+{
+  pid_t pid = getpid ();
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      if (call_clobbers (i % 2 ? SYS_GETPID : SYS_CLOSE))
+        fail ("registers changed by syscall %d", i % 2 ? SYS_GETPID : SYS_CLOSE);
+      if (getpid () != pid)
+        fail ("getpid changed from %d", pid);
+    }
+  msg ("%d system calls preserved all registers", ITERATIONS);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stress-syscall) begin
+(stress-syscall) 200000 system calls preserved all registers
+(stress-syscall) end
+stress-syscall: exit(0)
+EOF
+pass;
@@ -27,6 +27,7 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vdata.h"
 #endif
 #include "tests/threads/tests.h"
 #ifdef VM
@@ -35,6 +36,9 @@
 #ifdef FILESYS
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/dcache.h"
+#include "filesys/journal.h"
 #include "filesys/fsutil.h"
 #endif
 
@@ -100,6 +104,7 @@ main (void) {
 #ifdef USERPROG
 	exception_init ();
 	syscall_init ();
+	vdata_init ();
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
@@ -270,6 +275,7 @@ run_actions (char **argv) {
 		{"ls", 1, fsutil_ls},
 		{"cat", 2, fsutil_cat},
 		{"rm", 2, fsutil_rm},
+		{"mkfs", 2, fsutil_mkfs},
 		{"put", 2, fsutil_put},
 		{"get", 2, fsutil_get},
 #endif
@@ -316,6 +322,7 @@ usage (void) {
 			"  ls                 List files in the root directory.\n"
 			"  cat FILE           Print FILE to the console.\n"
 			"  rm FILE            Delete FILE.\n"
+			"  mkfs CHAN:DEV      Make a file system to mount on disk CHAN:DEV.\n"
 			"Use these actions indirectly via `pintos' -g and -p options:\n"
 			"  put FILE           Put FILE into file system from scratch disk.\n"
 			"  get FILE           Get FILE from file system into scratch disk.\n"
@@ -356,6 +363,9 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	dcache_print_stats ();
+	journal_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
@@ -362,6 +362,80 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 		cond_signal(cond, lock);
 }
 
+/* Initializes RWLOCK.  Any number of readers, or a single writer,
+   can hold a readers-writer lock at once.  A waiting writer keeps
+   new readers out, so that a steady stream of readers cannot
+   starve it. */
+void rwlock_init(struct rwlock *rwlock)
+{
+	ASSERT(rwlock != NULL);
+
+	lock_init(&rwlock->lock);
+	cond_init(&rwlock->readers_ok);
+	cond_init(&rwlock->writer_ok);
+	rwlock->reader_cnt = 0;
+	rwlock->writer_waiting_cnt = 0;
+	rwlock->writer = false;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it or
+   waits for it. */
+void rwlock_acquire_read(struct rwlock *rwlock)
+{
+	ASSERT(rwlock != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rwlock->lock);
+	while (rwlock->writer || rwlock->writer_waiting_cnt > 0)
+		cond_wait(&rwlock->readers_ok, &rwlock->lock);
+	rwlock->reader_cnt++;
+	lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, held for reading. */
+void rwlock_release_read(struct rwlock *rwlock)
+{
+	ASSERT(rwlock != NULL);
+
+	lock_acquire(&rwlock->lock);
+	ASSERT(rwlock->reader_cnt > 0);
+	if (--rwlock->reader_cnt == 0)
+		cond_signal(&rwlock->writer_ok, &rwlock->lock);
+	lock_release(&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or other
+   writer holds it. */
+void rwlock_acquire_write(struct rwlock *rwlock)
+{
+	ASSERT(rwlock != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rwlock->lock);
+	rwlock->writer_waiting_cnt++;
+	while (rwlock->writer || rwlock->reader_cnt > 0)
+		cond_wait(&rwlock->writer_ok, &rwlock->lock);
+	rwlock->writer_waiting_cnt--;
+	rwlock->writer = true;
+	lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, held for writing.  Hands it to the next waiting
+   writer if there is one, and otherwise to every waiting reader. */
+void rwlock_release_write(struct rwlock *rwlock)
+{
+	ASSERT(rwlock != NULL);
+
+	lock_acquire(&rwlock->lock);
+	ASSERT(rwlock->writer);
+	rwlock->writer = false;
+	if (rwlock->writer_waiting_cnt > 0)
+		cond_signal(&rwlock->writer_ok, &rwlock->lock);
+	else
+		cond_broadcast(&rwlock->readers_ok, &rwlock->lock);
+	lock_release(&rwlock->lock);
+}
+
 bool sema_compare_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
 {
 	const struct semaphore_elem *sa = list_entry(a, struct semaphore_elem, elem);
@@ -178,6 +178,23 @@ void thread_print_stats(void)
 				 idle_ticks, kernel_ticks, user_ticks);
 }
 
+/* Stores the number of timer ticks spent idle, in kernel threads
+	 and in user programs into *IDLE, *KERNEL and *USER. */
+void thread_get_ticks(long long *idle, long long *kernel, long long *user)
+{
+	*idle = idle_ticks;
+	*kernel = kernel_ticks;
+	*user = user_ticks;
+}
+
+/* Returns the number of threads ready to run.
+	 Must be called with interrupts off. */
+int thread_ready_cnt(void)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+	return list_size(&ready_list);
+}
+
 /* Creates a new kernel thread named NAME with the given initial
 	PRIORITY, which executes FUNCTION passing AUX as the argument,
 	and adds it to the ready queue.  Returns the thread identifier
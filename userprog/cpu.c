@@ -0,0 +1,30 @@
+/* cpu.c: Per-CPU data. */
+
+#include "userprog/cpu.h"
+#include <debug.h>
+#include <stddef.h>
+#include "intrinsic.h"
+
+#define MSR_KERNEL_GS_BASE 0xc0000102 /* %gs base after swapgs */
+
+/* Per-CPU data, indexed by CPU number. */
+static struct cpu cpus[CPU_MAX];
+
+/* Points MSR_KERNEL_GS_BASE to the running CPU's data, for
+ * syscall_entry.  The TSS must have been set up already. */
+void
+cpu_init (void) {
+	struct cpu *c = cpu_current ();
+
+	ASSERT (offsetof (struct cpu, user_rsp) == CPU_USER_RSP);
+	ASSERT (offsetof (struct cpu, tss) == CPU_TSS);
+	ASSERT (c->tss != NULL);
+	write_msr (MSR_KERNEL_GS_BASE, (uint64_t) c);
+}
+
+/* Returns the running CPU's data. */
+struct cpu *
+cpu_current (void) {
+	/* The boot CPU is the only one. */
+	return &cpus[0];
+}
@@ -6,7 +6,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vdata.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -91,6 +93,11 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	void *newpage;
 	bool writable;
 
+	/* The kernel data pages are not copied; __do_fork() maps the
+	 * child's own. */
+	if (vdata_overlaps (va, PGSIZE))
+		return true;
+
 	/* 1. TODO: If the parent_page is kernel page, then return immediately. */
 
 	/* 2. Resolve VA from the parent's page map level 4. */
@@ -143,6 +150,11 @@ __do_fork (void *aux) {
 		goto error;
 #endif
 
+	/* Map the kernel data pages, with a private page that holds the
+	 * child's own pid. */
+	if (!vdata_map (current))
+		goto error;
+
 	/* TODO: Your code goes here.
 	 * TODO: Hint) To duplicate the file object, use `file_duplicate`
 	 * TODO:       in include/filesys/file.h. Note that parent should not return
@@ -216,6 +228,7 @@ process_exit (void) {
 	 * TODO: project2/process_termination.html).
 	 * TODO: We recommend you to implement process resource cleanup here. */
 
+	syscall_exit ();
 	process_cleanup ();
 }
 
@@ -240,6 +253,7 @@ process_cleanup (void) {
 		 * directory before destroying the process's page
 		 * directory, or our active page directory will be one
 		 * that's been freed (and cleared). */
+		vdata_unmap (curr);
 		curr->pml4 = NULL;
 		pml4_activate (NULL);
 		pml4_destroy (pml4);
@@ -411,6 +425,10 @@ load (const char *file_name, struct intr_frame *if_) {
 	if (!setup_stack (if_))
 		goto done;
 
+	/* Map the kernel data pages. */
+	if (!vdata_map (t))
+		goto done;
+
 	/* Start address. */
 	if_->rip = ehdr.e_entry;
 
@@ -466,6 +484,11 @@ validate_segment (const struct Phdr *phdr, struct file *file) {
 	if (phdr->p_vaddr < PGSIZE)
 		return false;
 
+	/* The kernel data pages are reserved. */
+	if (vdata_overlaps ((void *) (phdr->p_vaddr & ~PGMASK),
+				phdr->p_memsz + (phdr->p_vaddr & PGMASK)))
+		return false;
+
 	/* It's okay. */
 	return true;
 }
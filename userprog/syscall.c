@@ -1,15 +1,467 @@
 #include "userprog/syscall.h"
+#include <dirent.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
+#include "threads/vaddr.h"
+#include "userprog/cpu.h"
 #include "userprog/gdt.h"
+#include "userprog/uaccess.h"
+#include "userprog/uring.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
+uint64_t syscall_fast_handler (uint64_t, uint64_t, uint64_t, uint64_t);
+
+/* Bit N is set if system call N takes the fast entry path.  Read by
+ * syscall_entry. */
+uint64_t syscall_fast_mask;
+
+/* Number of file descriptors per process.  0 and 1 are the
+ * console and are never handed out. */
+#define FD_MAX 64
+
+/* An open file descriptor.  Directories are opened as such, so
+ * that each descriptor keeps its own readdir position. */
+struct fd {
+	struct file *file;                  /* Open file, or null. */
+	struct dir *dir;                    /* Open directory, or null. */
+};
+
+/* A process's descriptors.  A uring poller uses them too, from its
+ * own thread. */
+struct fd_table {
+	struct lock lock;                   /* Protects FDS. */
+	struct fd fds[FD_MAX];              /* Descriptors, by number. */
+};
+
+/* Terminates the current process with STATUS. */
+static void NO_RETURN
+exit_process (int status) {
+	printf ("%s: exit(%d)\n", thread_name (), status);
+	thread_exit ();
+}
+
+/* Kills the current process for passing a bad pointer, unless it
+ * is carrying out a uring request, which fails instead: a poller
+ * only borrows the process's page table and descriptors and must
+ * not exit with them.  Returns only in that case. */
+static void
+bad_pointer (void) {
+	if (!thread_current ()->ring_request)
+		exit_process (-1);
+}
+
+/* Copies the user string at USTR into the SIZE bytes at BUF,
+ * killing the process if it is not mapped.  Returns false if it
+ * does not fit, or if it is not mapped in a uring request. */
+static bool
+user_string (const char *ustr, char *buf, size_t size) {
+	long len = strncpy_from_user (buf, ustr, size);
+
+	if (len < 0) {
+		bad_pointer ();
+		return false;
+	}
+	return (size_t) len < size;
+}
+
+/* Returns descriptor FD of TABLE, or a null pointer if FD is not
+ * open.  Must be called with TABLE's lock held. */
+static struct fd *
+fd_lookup (struct fd_table *table, int fd) {
+	if (fd < 2 || fd >= FD_MAX)
+		return NULL;
+	if (table->fds[fd].file == NULL && table->fds[fd].dir == NULL)
+		return NULL;
+	return &table->fds[fd];
+}
+
+/* Closes descriptor D. */
+static void
+fd_close (struct fd *d) {
+	file_close (d->file);
+	dir_close (d->dir);
+	d->file = NULL;
+	d->dir = NULL;
+}
+
+/* Opens NAME, a file or a directory, which is "/" or a mount point,
+ * and returns a new descriptor for it, or -1. */
+static uint64_t
+sys_open (uint64_t uname, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	struct fd_table *table;
+	char name[PATH_MAX];
+	struct fd fd = { NULL, NULL };
+	int i;
+
+	if (!user_string ((const char *) uname, name, sizeof name))
+		return -1;
+	if (!syscall_fd_table_init ())
+		return -1;
+
+	/* The roots of the mounts are the only directories there are. */
+	fd.dir = filesys_open_dir (name);
+	if (fd.dir == NULL)
+		fd.file = filesys_open (name);
+	if (fd.file == NULL && fd.dir == NULL)
+		return -1;
+
+	table = thread_current ()->fd_table;
+	lock_acquire (&table->lock);
+	for (i = 2; i < FD_MAX; i++)
+		if (table->fds[i].file == NULL && table->fds[i].dir == NULL) {
+			table->fds[i] = fd;
+			break;
+		}
+	lock_release (&table->lock);
+	if (i == FD_MAX) {
+		fd_close (&fd);
+		return -1;
+	}
+	return i;
+}
+
+/* Closes FD, if it is open.  A uring request still using its file
+ * keeps the file open until it is done. */
+static uint64_t
+sys_close (uint64_t fd, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	struct fd_table *table = thread_current ()->fd_table;
+	struct fd d = { NULL, NULL }, *slot;
+
+	if (table == NULL)
+		return 0;
+	lock_acquire (&table->lock);
+	slot = fd_lookup (table, fd);
+	if (slot != NULL) {
+		d = *slot;
+		slot->file = NULL;
+		slot->dir = NULL;
+	}
+	lock_release (&table->lock);
+	fd_close (&d);
+	return 0;
+}
+
+/* Returns the open file FD of the current process, or a null
+ * pointer if FD is not an open file.  The caller must drop the
+ * reference it gets with file_close(), so that closing FD meanwhile
+ * does not free the file under it. */
+static struct file *
+fd_file (int fd) {
+	struct fd_table *table = thread_current ()->fd_table;
+	struct file *file = NULL;
+	struct fd *d;
+
+	if (table == NULL)
+		return NULL;
+	lock_acquire (&table->lock);
+	d = fd_lookup (table, fd);
+	if (d != NULL && d->file != NULL)
+		file = file_ref (d->file);
+	lock_release (&table->lock);
+	return file;
+}
+
+/* Returns the size of file FD in bytes, or -1. */
+static uint64_t
+sys_filesize (uint64_t fd, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	struct file *file = fd_file (fd);
+	uint64_t size;
+
+	if (file == NULL)
+		return -1;
+	size = file_length (file);
+	file_close (file);
+	return size;
+}
+
+/* Reads, or writes if WRITE is true, SIZE bytes between user
+ * buffer UBUF and FILE, or the console if FILE is null, through a
+ * kernel buffer.  Kills the process if UBUF is bad.  Returns the
+ * number of bytes transferred, or -1 if UBUF is bad in a uring
+ * request. */
+static int
+transfer (struct file *file, uint8_t *ubuf, size_t size, bool write) {
+	uint8_t small[128];
+	uint8_t *buf = small;
+	size_t buf_size = sizeof small;
+	size_t done = 0;
+
+	if (!access_ok (ubuf, size)) {
+		bad_pointer ();
+		return -1;
+	}
+
+	/* Large transfers go a page at a time. */
+	if (size > sizeof small) {
+		uint8_t *page = palloc_get_page (0);
+
+		if (page != NULL) {
+			buf = page;
+			buf_size = PGSIZE;
+		}
+	}
+
+	while (done < size) {
+		size_t chunk = size - done < buf_size ? size - done : buf_size;
+		size_t i, n;
+		bool ok;
+
+		if (write) {
+			ok = copy_from_user (buf, ubuf + done, chunk);
+			if (!ok)
+				n = 0;
+			else if (file == NULL) {
+				putbuf ((const char *) buf, chunk);
+				n = chunk;
+			} else
+				n = file_write (file, buf, chunk);
+		} else {
+			if (file == NULL) {
+				for (i = 0; i < chunk; i++)
+					buf[i] = input_getc ();
+				n = chunk;
+			} else
+				n = file_read (file, buf, chunk);
+			ok = copy_to_user (ubuf + done, buf, n);
+		}
+		if (!ok) {
+			if (buf != small)
+				palloc_free_page (buf);
+			bad_pointer ();
+			return -1;
+		}
+		done += n;
+		if (n < chunk)
+			break;
+	}
+	if (buf != small)
+		palloc_free_page (buf);
+	return done;
+}
+
+/* Reads up to SIZE bytes from FD, the keyboard if it is 0, into
+ * UBUF.  Returns the number of bytes read, or -1. */
+static uint64_t
+sys_read (uint64_t fd, uint64_t ubuf, uint64_t size) {
+	struct file *file = NULL;
+	int n;
+
+	if (fd != STDIN_FILENO && (file = fd_file (fd)) == NULL)
+		return -1;
+	n = transfer (file, (uint8_t *) ubuf, size, false);
+	file_close (file);
+	return n;
+}
+
+/* Writes SIZE bytes from UBUF to FD, the console if it is 1.
+ * Returns the number of bytes written, or -1. */
+static uint64_t
+sys_write (uint64_t fd, uint64_t ubuf, uint64_t size) {
+	struct file *file = NULL;
+	int n;
+
+	if (fd != STDOUT_FILENO && (file = fd_file (fd)) == NULL)
+		return -1;
+	n = transfer (file, (uint8_t *) ubuf, size, true);
+	file_close (file);
+	return n;
+}
+
+/* Sets the position of file FD to POS. */
+static uint64_t
+sys_seek (uint64_t fd, uint64_t pos, uint64_t a3 UNUSED) {
+	struct file *file = fd_file (fd);
+
+	if (file != NULL)
+		file_seek (file, (unsigned) pos);
+	file_close (file);
+	return 0;
+}
+
+/* Returns the position of file FD, or -1. */
+static uint64_t
+sys_tell (uint64_t fd, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	struct file *file = fd_file (fd);
+	uint64_t pos;
+
+	if (file == NULL)
+		return -1;
+	pos = file_tell (file);
+	file_close (file);
+	return pos;
+}
+
+/* Returns the process id of the current process. */
+static uint64_t
+sys_getpid (uint64_t a1 UNUSED, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	return thread_tid ();
+}
+
+/* Reads the next entry of directory FD into NAME. */
+static uint64_t
+sys_readdir (uint64_t fd, uint64_t uname, uint64_t a3 UNUSED) {
+	struct fd_table *table = thread_current ()->fd_table;
+	char buf[NAME_MAX + 1];
+	struct fd *d;
+	bool found;
+
+	if (!access_ok ((void *) uname, sizeof buf)) {
+		bad_pointer ();
+		return false;
+	}
+	if (table == NULL)
+		return false;
+
+	/* The descriptor table stays locked while the directory is
+	 * read, so that it cannot be closed meanwhile. */
+	lock_acquire (&table->lock);
+	d = fd_lookup (table, fd);
+	found = d != NULL && d->dir != NULL && dir_readdir (d->dir, buf);
+	lock_release (&table->lock);
+	if (!found)
+		return false;
+	if (!copy_to_user ((void *) uname, buf, sizeof buf)) {
+		bad_pointer ();
+		return false;
+	}
+	return true;
+}
+
+/* Fills the SIZE bytes at UENTS with as many packed entries of
+ * directory FD as fit, starting at its position.  Returns the
+ * number of bytes stored, 0 at the end of the directory, or -1 if
+ * FD is not a directory or not even one entry fits. */
+static uint64_t
+sys_getdents (uint64_t fd, uint64_t uents_, uint64_t size) {
+	struct fd_table *table = thread_current ()->fd_table;
+	struct dirent *uents = (struct dirent *) uents_;
+	struct dirent *ents;
+	struct fd *d;
+	size_t cnt;
+
+	if (!access_ok (uents, size)) {
+		bad_pointer ();
+		return -1;
+	}
+	if (table == NULL || size < sizeof *ents)
+		return -1;
+
+	/* Gather a page of entries at a time, outside of user memory. */
+	cnt = size / sizeof *ents;
+	if (cnt > PGSIZE / sizeof *ents)
+		cnt = PGSIZE / sizeof *ents;
+	ents = palloc_get_page (0);
+	if (ents == NULL)
+		return -1;
+	lock_acquire (&table->lock);
+	d = fd_lookup (table, fd);
+	if (d == NULL || d->dir == NULL) {
+		lock_release (&table->lock);
+		palloc_free_page (ents);
+		return -1;
+	}
+	cnt = dir_readdir_batch (d->dir, ents, cnt);
+	lock_release (&table->lock);
+	if (!copy_to_user (uents, ents, cnt * sizeof *ents)) {
+		palloc_free_page (ents);
+		bad_pointer ();
+		return -1;
+	}
+	palloc_free_page (ents);
+	return cnt * sizeof *ents;
+}
+
+/* Mounts the file system on disk CHAN:DEV at PATH.  Returns 0 if
+ * successful, -1 on failure. */
+static uint64_t
+sys_mount (uint64_t upath, uint64_t chan, uint64_t dev) {
+	char path[PATH_MAX];
+
+	if (!user_string ((const char *) upath, path, sizeof path))
+		return -1;
+	return filesys_mount (path, chan, dev) ? 0 : -1;
+}
+
+/* Unmounts the file system mounted at PATH.  Returns 0 if
+ * successful, -1 on failure. */
+static uint64_t
+sys_umount (uint64_t upath, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	char path[PATH_MAX];
+
+	if (!user_string ((const char *) upath, path, sizeof path))
+		return -1;
+	return filesys_umount (path) ? 0 : -1;
+}
+
+/* Sets up submission and completion rings in the page at UADDR.
+ * Returns 0 if successful, -1 on failure. */
+static uint64_t
+sys_uring_setup (uint64_t uaddr, uint64_t flags, uint64_t a3 UNUSED) {
+	return uring_setup ((void *) uaddr, flags);
+}
+
+/* Processes up to TO_SUBMIT queued ring requests and waits for
+ * MIN_COMPLETE completions. */
+static uint64_t
+sys_uring_enter (uint64_t to_submit, uint64_t min_complete,
+		uint64_t flags) {
+	return uring_enter (to_submit, min_complete, flags);
+}
+
+/* Terminates the current process with exit status STATUS. */
+static uint64_t
+sys_exit (uint64_t status, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	exit_process (status);
+}
+
+/* A system call handler.  Takes the first three argument registers
+ * and returns the value for %rax. */
+typedef uint64_t syscall_func (uint64_t, uint64_t, uint64_t);
+
+/* An entry of the system call table. */
+struct syscall {
+	syscall_func *func;                 /* Handler, or null. */
+	bool fast;                          /* Take the light entry path? */
+};
+
+/* System calls, indexed by number.  Fast ones neither look at nor
+ * change the interrupted user state beyond their arguments and
+ * return value, and never exit, so syscall_entry calls them through
+ * syscall_fast_handler() without saving a full intr_frame. */
+static const struct syscall syscall_table[] = {
+	[SYS_EXIT] = {sys_exit, false},
+	[SYS_OPEN] = {sys_open, false},
+	[SYS_FILESIZE] = {sys_filesize, true},
+	[SYS_READ] = {sys_read, false},
+	[SYS_WRITE] = {sys_write, false},
+	[SYS_SEEK] = {sys_seek, true},
+	[SYS_TELL] = {sys_tell, true},
+	[SYS_CLOSE] = {sys_close, false},
+	[SYS_READDIR] = {sys_readdir, false},
+	[SYS_MOUNT] = {sys_mount, false},
+	[SYS_UMOUNT] = {sys_umount, false},
+	[SYS_GETDENTS] = {sys_getdents, false},
+	[SYS_GETPID] = {sys_getpid, true},
+	[SYS_URING_SETUP] = {sys_uring_setup, false},
+	[SYS_URING_ENTER] = {sys_uring_enter, false},
+};
+
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
 
 /* System call.
  *
@@ -26,6 +478,8 @@ void syscall_handler (struct intr_frame *);
 
 void
 syscall_init (void) {
+	size_t nr;
+
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
 			((uint64_t)SEL_KCSEG) << 32);
 	write_msr(MSR_LSTAR, (uint64_t) syscall_entry);
@@ -35,12 +489,84 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
+
+	/* syscall_entry finds its scratch space and kernel stack through
+	 * the per-CPU data. */
+	cpu_init ();
+
+	ASSERT (SYSCALL_CNT <= 64);
+	for (nr = 0; nr < SYSCALL_CNT; nr++)
+		if (syscall_table[nr].fast)
+			syscall_fast_mask |= 1ULL << nr;
+}
+
+/* Gives the current process a descriptor table, if it has none
+ * yet.  Returns false if out of memory. */
+bool
+syscall_fd_table_init (void) {
+	struct thread *t = thread_current ();
+
+	if (t->fd_table == NULL) {
+		t->fd_table = calloc (1, sizeof *t->fd_table);
+		if (t->fd_table != NULL)
+			lock_init (&t->fd_table->lock);
+	}
+	return t->fd_table != NULL;
 }
 
-/* The main system call interface */
+/* Carries out system call NR with arguments A1, A2 and A3 for a
+ * uring request of the current process, and returns its result, or
+ * -1 if there is no such system call.  A bad pointer makes the call
+ * fail with -1 instead of killing the process, and exit() is
+ * refused, so that a poller never exits in the process's place. */
+int64_t
+syscall_run (int nr, uint64_t a1, uint64_t a2, uint64_t a3) {
+	struct thread *t = thread_current ();
+	int64_t result;
+
+	if (nr < 0 || (size_t) nr >= SYSCALL_CNT || nr == SYS_EXIT
+			|| syscall_table[nr].func == NULL)
+		return -1;
+	t->ring_request = true;
+	result = syscall_table[nr].func (a1, a2, a3);
+	t->ring_request = false;
+	return result;
+}
+
+/* Closes every descriptor of the current process, after stopping
+ * anything that uses them.  Called when the process exits. */
 void
-syscall_handler (struct intr_frame *f UNUSED) {
-	// TODO: Your implementation goes here.
-	printf ("system call!\n");
-	thread_exit ();
+syscall_exit (void) {
+	struct thread *t = thread_current ();
+	struct fd *fds;
+	int i;
+
+	uring_destroy ();
+	if (t->fd_table == NULL)
+		return;
+	fds = t->fd_table->fds;
+	for (i = 2; i < FD_MAX; i++)
+		if (fds[i].file != NULL || fds[i].dir != NULL)
+			fd_close (&fds[i]);
+	free (t->fd_table);
+	t->fd_table = NULL;
+}
+
+/* The main system call interface.  Called by syscall_entry with a
+ * full intr_frame for every system call not marked fast. */
+void
+syscall_handler (struct intr_frame *f) {
+	uint64_t nr = f->R.rax;
+
+	if (nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
+		exit_process (-1);
+	f->R.rax = syscall_table[nr].func (f->R.rdi, f->R.rsi, f->R.rdx);
+}
+
+/* Handles fast system call NR with arguments A1, A2 and A3.  Called
+ * by syscall_entry, which saves only the registers that a C function
+ * may clobber, and returns the value for %rax. */
+uint64_t
+syscall_fast_handler (uint64_t a1, uint64_t a2, uint64_t a3, uint64_t nr) {
+	return syscall_table[nr].func (a1, a2, a3);
 }
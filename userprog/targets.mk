@@ -2,5 +2,10 @@ userprog_SRC  = userprog/process.c	# Process loading.
 userprog_SRC += userprog/exception.c	# User exception handler.
 userprog_SRC += userprog/syscall-entry.S # System call entry.
 userprog_SRC += userprog/syscall.c	# System call handler.
+userprog_SRC += userprog/uaccess.c	# User memory access.
+userprog_SRC += userprog/usercopy.S	# User memory copy routines.
+userprog_SRC += userprog/uring.c	# Batched system call rings.
+userprog_SRC += userprog/vdata.c	# Kernel data pages for processes.
 userprog_SRC += userprog/gdt.c		# GDT initialization.
 userprog_SRC += userprog/tss.c		# TSS management.
+userprog_SRC += userprog/cpu.c		# Per-CPU data.
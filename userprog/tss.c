@@ -1,6 +1,7 @@
 #include "userprog/tss.h"
 #include <debug.h>
 #include <stddef.h>
+#include "userprog/cpu.h"
 #include "userprog/gdt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
@@ -45,22 +46,21 @@
  *      stack pointer to point to the new thread's kernel stack.
  *      (The call is in schedule in thread.c.) */
 
-/* Kernel TSS. */
-struct task_state *tss;
-
-/* Initializes the kernel TSS. */
+/* Initializes the kernel TSS of the running CPU. */
 void
 tss_init (void) {
 	/* Our TSS is never used in a call gate or task gate, so only a
 	 * few fields of it are ever referenced, and those are the only
 	 * ones we initialize. */
-	tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	cpu_current ()->tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 	tss_update (thread_current ());
 }
 
-/* Returns the kernel TSS. */
+/* Returns the kernel TSS of the running CPU. */
 struct task_state *
 tss_get (void) {
+	struct task_state *tss = cpu_current ()->tss;
+
 	ASSERT (tss != NULL);
 	return tss;
 }
@@ -69,6 +69,8 @@ tss_get (void) {
  * of the thread stack. */
 void
 tss_update (struct thread *next) {
+	struct task_state *tss = cpu_current ()->tss;
+
 	ASSERT (tss != NULL);
 	tss->rsp0 = (uint64_t) next + PGSIZE;
 }
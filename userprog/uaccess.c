@@ -0,0 +1,124 @@
+/* uaccess.c: Copying to and from user memory.
+ *
+ * User pointers are not checked page by page before they are used.
+ * The copy routines in usercopy.S access user memory directly, and a
+ * fault on a bad pointer is turned into an error return through the
+ * exception fixup table, so that a valid pointer costs nothing
+ * extra. */
+
+#include "userprog/uaccess.h"
+#include <stdint.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+
+/* An entry of the exception fixup table, built by usercopy.S. */
+struct ex_entry {
+	uint64_t insn;                      /* Instruction that may fault. */
+	uint64_t fixup;                     /* Where to resume if it does. */
+};
+
+/* Bounds of the table, from the linker script. */
+extern const struct ex_entry __start_ex_table[], __stop_ex_table[];
+
+size_t copy_user (void *dst, const void *src, size_t size);
+long strncpy_user (char *dst, const char *src, size_t size);
+
+/* Returns true if the SIZE bytes at UADDR are all in user space.
+ * Says nothing about whether they are mapped. */
+bool
+access_ok (const void *uaddr, size_t size) {
+	uint64_t start = (uint64_t) uaddr;
+
+	return start <= KERN_BASE && size <= KERN_BASE - start;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.
+ * Returns false if any of them is not readable user memory. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size) {
+	return access_ok (usrc, size) && copy_user (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.
+ * Returns false if any of them is not writable user memory. */
+bool
+copy_to_user (void *udst, const void *src, size_t size) {
+	return access_ok (udst, size) && copy_user (udst, src, size) == 0;
+}
+
+/* Copies the string at user address USRC, with its null terminator,
+ * into the SIZE bytes at DST.  Returns its length, SIZE if it does
+ * not fit, or -1 if it is not readable user memory. */
+long
+strncpy_from_user (char *dst, const char *usrc, size_t size) {
+	uint64_t start = (uint64_t) usrc;
+	long len;
+
+	if (start >= KERN_BASE)
+		return -1;
+
+	/* Never read past the end of user space. */
+	if (size > KERN_BASE - start) {
+		len = strncpy_user (dst, usrc, KERN_BASE - start);
+		return len == (long) (KERN_BASE - start) ? -1 : len;
+	}
+	return strncpy_user (dst, usrc, size);
+}
+
+/* Called on a page fault in the kernel.  If F faulted in one of the
+ * user memory accessors, makes it resume at its fixup code and
+ * returns true. */
+bool
+uaccess_fixup (struct intr_frame *f) {
+	const struct ex_entry *e;
+
+	for (e = __start_ex_table; e < __stop_ex_table; e++)
+		if (e->insn == f->rip) {
+			f->rip = e->fixup;
+			return true;
+		}
+	return false;
+}
+
+/* Returns true if the SIZE bytes at UADDR are user memory mapped in
+ * PML4, that is also writable if WRITE is true.  For kernel threads
+ * that act for a process and must not fault on its behalf. */
+bool
+user_mapped (uint64_t *pml4, const void *uaddr, size_t size, bool write) {
+	uint64_t end = (uint64_t) uaddr + size;
+	uint64_t va;
+
+	if (!access_ok (uaddr, size))
+		return false;
+	for (va = (uint64_t) pg_round_down (uaddr); va < end; va += PGSIZE) {
+		uint64_t *pte = pml4e_walk (pml4, va, 0);
+
+		if (pte == NULL || !(*pte & PTE_P) || !is_user_pte (pte)
+				|| (write && !is_writable (pte)))
+			return false;
+	}
+	return true;
+}
+
+/* Returns true if PML4 maps the user string at USTR up to its null
+ * terminator, or up to its first SIZE bytes if it is longer. */
+bool
+user_string_mapped (uint64_t *pml4, const char *ustr, size_t size) {
+	while (size > 0) {
+		size_t n = PGSIZE - pg_ofs (ustr);
+		const char *kstr;
+
+		if (!user_mapped (pml4, ustr, 1, false))
+			return false;
+		kstr = pml4_get_page (pml4, ustr);
+		if (n > size)
+			n = size;
+		if (memchr (kstr, '\0', n) != NULL)
+			return true;
+		ustr += n;
+		size -= n;
+	}
+	return true;
+}
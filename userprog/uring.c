@@ -0,0 +1,298 @@
+/* uring.c: Submission and completion rings for batched system
+ * calls.  See lib/uring.h for the layout of the shared page.
+ *
+ * Requests are carried out by the same handlers as the system
+ * calls they stand for, through syscall_run().  Without a poller,
+ * uring_enter() carries them out in the process's own thread.  With
+ * one, a kernel thread that borrows the process's address space and
+ * descriptor table picks them up as they are queued, so that the
+ * process need not enter the kernel at all while the poller is
+ * awake.  The descriptor table is locked, and each request holds
+ * a reference to its file, so the process may open and close
+ * descriptors directly while a poller runs.  A request with a bad
+ * pointer fails, so the poller never exits in the process's place.
+ * The rings live in a page of the process, which is kept in memory
+ * until they are torn down. */
+
+#include "userprog/uring.h"
+#include <syscall-nr.h>
+#include <uring.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* Empty polls before the poller goes to sleep. */
+#define POLL_IDLE 1000
+
+/* A process's rings. */
+struct uring_ctx {
+	struct uring *ring;                 /* Process's page, at its kernel
+	                                       address. */
+	void *uaddr;                        /* Where the process maps it. */
+	struct thread *owner;               /* Process the rings belong to. */
+	bool polling;                       /* Is there a poller? */
+	bool stop;                          /* Tells the poller to exit. */
+	struct semaphore done;              /* Up'd when the poller exits. */
+
+	/* Sleeping and waking, with interrupts off.  Each semaphore is
+	 * up'd only while its flag is set, which clears the flag, so
+	 * neither counts past one. */
+	bool sleeping;                      /* Poller waits on WAKEUP? */
+	struct semaphore wakeup;            /* Wakes a sleeping poller. */
+	bool waiting;                       /* Process waits on COMPLETE? */
+	struct semaphore complete;          /* Up'd by the poller when it
+	                                       posts completions. */
+};
+
+/* Wakes the poller of CTX if it sleeps. */
+static void
+poller_wake (struct uring_ctx *ctx) {
+	enum intr_level old_level = intr_disable ();
+
+	if (ctx->sleeping) {
+		ctx->sleeping = false;
+		sema_up (&ctx->wakeup);
+	}
+	intr_set_level (old_level);
+}
+
+/* Returns true if the memory that request SQE points to is mapped,
+ * so that carrying it out cannot fault. */
+static bool
+sqe_mapped (const struct uring_sqe *sqe) {
+	uint64_t *pml4 = thread_current ()->pml4;
+
+	switch (sqe->op) {
+		case URING_READ:
+			return user_mapped (pml4, (void *) sqe->addr, sqe->len, true);
+		case URING_WRITE:
+			return user_mapped (pml4, (void *) sqe->addr, sqe->len, false);
+		case URING_OPEN:
+			return user_string_mapped (pml4, (const char *) sqe->addr,
+					PATH_MAX);
+		default:
+			return true;
+	}
+}
+
+/* Carries out request SQE and returns its result.  A request with
+ * a bad pointer fails.  If CHECK is true, so does one whose memory
+ * is not mapped, which the poller cannot fault in. */
+static int64_t
+sqe_run (const struct uring_sqe *sqe, bool check) {
+	if (check && !sqe_mapped (sqe))
+		return -1;
+	switch (sqe->op) {
+		case URING_READ:
+			return syscall_run (SYS_READ, sqe->fd, sqe->addr, sqe->len);
+		case URING_WRITE:
+			return syscall_run (SYS_WRITE, sqe->fd, sqe->addr, sqe->len);
+		case URING_OPEN:
+			return syscall_run (SYS_OPEN, sqe->addr, 0, 0);
+		case URING_CLOSE:
+			return syscall_run (SYS_CLOSE, sqe->fd, 0, 0);
+		case URING_SEEK:
+			return syscall_run (SYS_SEEK, sqe->fd, sqe->len, 0);
+		default:
+			return -1;
+	}
+}
+
+/* Carries out up to MAX queued requests of CTX, posting a
+ * completion for each, and returns how many it carried out.  Stops
+ * early if the completion ring is full. */
+static unsigned
+run_requests (struct uring_ctx *ctx, unsigned max, bool check) {
+	struct uring *r = ctx->ring;
+	unsigned n;
+
+	for (n = 0; n < max && r->sq_head != r->sq_tail
+			&& r->cq_tail - r->cq_head < URING_ENTRIES; n++) {
+		struct uring_sqe sqe;
+		struct uring_cqe *cqe;
+
+		/* The process may reuse the slot once sq_head moves. */
+		barrier ();
+		sqe = r->sq[r->sq_head % URING_ENTRIES];
+		r->sq_head++;
+
+		cqe = &r->cq[r->cq_tail % URING_ENTRIES];
+		cqe->user_data = sqe.user_data;
+		cqe->res = sqe_run (&sqe, check);
+		barrier ();
+		r->cq_tail++;
+	}
+	return n;
+}
+
+/* Poller thread for the rings CTX.  Runs in the owner's address
+ * space with the owner's descriptors, and sleeps when there has
+ * been nothing to do for a while. */
+static void
+poller (void *ctx_) {
+	struct uring_ctx *ctx = ctx_;
+	struct uring *r = ctx->ring;
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
+	int idle = 0;
+
+	old_level = intr_disable ();
+	t->pml4 = ctx->owner->pml4;
+	t->fd_table = ctx->owner->fd_table;
+	process_activate (t);
+	intr_set_level (old_level);
+
+	while (!ctx->stop) {
+		if (run_requests (ctx, URING_ENTRIES, true) > 0) {
+			/* Let a process waiting in uring_enter() check its
+			 * completions. */
+			old_level = intr_disable ();
+			if (ctx->waiting) {
+				ctx->waiting = false;
+				sema_up (&ctx->complete);
+			}
+			intr_set_level (old_level);
+			idle = 0;
+			continue;
+		}
+		if (++idle < POLL_IDLE) {
+			thread_yield ();
+			continue;
+		}
+
+		/* A request queued before the flag was seen is caught by
+		 * the check below; one queued after it comes with a
+		 * wakeup. */
+		r->flags |= URING_NEED_WAKEUP;
+		barrier ();
+		old_level = intr_disable ();
+		if (r->sq_head == r->sq_tail && !ctx->stop) {
+			ctx->sleeping = true;
+			sema_down (&ctx->wakeup);
+		}
+		intr_set_level (old_level);
+		r->flags &= ~URING_NEED_WAKEUP;
+		idle = 0;
+	}
+
+	/* Give back the owner's resources before exiting, so that they
+	 * are not freed twice. */
+	old_level = intr_disable ();
+	t->pml4 = NULL;
+	t->fd_table = NULL;
+	process_activate (t);
+	intr_set_level (old_level);
+	sema_up (&ctx->done);
+}
+
+/* Sets up rings for the current process in the page at user
+ * address UADDR, with a poller if FLAGS has URING_SETUP_POLL.
+ * Returns 0 if successful, -1 on failure. */
+int
+uring_setup (void *uaddr, unsigned flags) {
+	struct thread *t = thread_current ();
+	struct uring_ctx *ctx;
+
+	if (t->uring != NULL || pg_ofs (uaddr) != 0
+			|| !user_mapped (t->pml4, uaddr, PGSIZE, true)
+			|| !syscall_fd_table_init ())
+		return -1;
+	ctx = calloc (1, sizeof *ctx);
+	if (ctx == NULL)
+		return -1;
+
+	/* The rings stay in the process's own page, which is used
+	 * through its kernel address.  Without VM, the page is freed
+	 * only when the process's page table is destroyed, after the
+	 * rings are torn down; with VM, it is pinned until then. */
+#ifdef VM
+	if (!vm_pin_page (uaddr)) {
+		free (ctx);
+		return -1;
+	}
+#endif
+	ctx->ring = pml4_get_page (t->pml4, uaddr);
+	ctx->uaddr = uaddr;
+	ctx->owner = t;
+	ctx->polling = (flags & URING_SETUP_POLL) != 0;
+	sema_init (&ctx->wakeup, 0);
+	sema_init (&ctx->complete, 0);
+	sema_init (&ctx->done, 0);
+	t->uring = ctx;
+	if (ctx->polling
+			&& thread_create ("uring-poll", PRI_DEFAULT, poller, ctx)
+			== TID_ERROR) {
+		ctx->polling = false;
+		uring_destroy ();
+		return -1;
+	}
+	return 0;
+}
+
+/* Carries out up to TO_SUBMIT queued requests of the current
+ * process, or just wakes the poller if there is one, then waits
+ * until MIN_COMPLETE completions are ready or no requests are
+ * left.  FLAGS is accepted for URING_ENTER_WAKEUP, which a sleeping
+ * poller is woken without.  Returns the number of requests carried
+ * out, which is 0 with a poller, or -1 if the process has no
+ * rings. */
+int
+uring_enter (unsigned to_submit, unsigned min_complete,
+		unsigned flags UNUSED) {
+	struct uring_ctx *ctx = thread_current ()->uring;
+	struct uring *r;
+	enum intr_level old_level;
+
+	if (ctx == NULL)
+		return -1;
+	r = ctx->ring;
+	if (!ctx->polling)
+		return run_requests (ctx, to_submit, false);
+
+	/* The poller only sleeps with nothing queued, and ups COMPLETE
+	 * after every batch, so once it is awake each wait below ends.
+	 * A full completion ring satisfies any MIN_COMPLETE. */
+	if (min_complete > URING_ENTRIES)
+		min_complete = URING_ENTRIES;
+	poller_wake (ctx);
+	old_level = intr_disable ();
+	while (r->cq_tail - r->cq_head < min_complete
+			&& r->sq_head != r->sq_tail) {
+		ctx->waiting = true;
+		sema_down (&ctx->complete);
+	}
+	ctx->waiting = false;
+	intr_set_level (old_level);
+	return 0;
+}
+
+/* Tears down the rings of the current process, stopping its
+ * poller.  Called when the process exits. */
+void
+uring_destroy (void) {
+	struct thread *t = thread_current ();
+	struct uring_ctx *ctx = t->uring;
+
+	if (ctx == NULL)
+		return;
+	if (ctx->polling) {
+		ctx->stop = true;
+		poller_wake (ctx);
+		sema_down (&ctx->done);
+	}
+
+#ifdef VM
+	vm_unpin_page (ctx->uaddr);
+#endif
+	t->uring = NULL;
+	free (ctx);
+}
@@ -0,0 +1,102 @@
+/* vdata.c: Read-only kernel data pages mapped into every process.
+ * See lib/vdata.h for their layout. */
+
+#include "userprog/vdata.h"
+#include <debug.h>
+#include <vdata.h>
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* End of the kernel data pages. */
+#define VDATA_END (VDATA_PROC_ADDR + PGSIZE)
+
+/* The shared page, at its kernel address, or null before
+ * vdata_init(). */
+static struct vdata *vdata;
+
+/* Allocates the shared page. */
+void
+vdata_init (void) {
+	struct vdata *v = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+
+	v->version = VDATA_VERSION;
+	v->timer_freq = TIMER_FREQ;
+	vdata = v;
+}
+
+/* Updates the shared page at timer tick TICKS.  Called from the
+ * timer interrupt handler. */
+void
+vdata_tick (int64_t ticks) {
+	struct vdata *v = vdata;
+	long long idle, kernel, user;
+
+	if (v == NULL)
+		return;
+	thread_get_ticks (&idle, &kernel, &user);
+
+	v->seq++;
+	barrier ();
+	v->ticks = ticks;
+	v->idle_ticks = idle;
+	v->kernel_ticks = kernel;
+	v->user_ticks = user;
+	v->ready_cnt = thread_ready_cnt ();
+	v->load_avg = thread_get_load_avg ();
+	barrier ();
+	v->seq++;
+}
+
+/* Maps the shared page and a new private page into T's address
+ * space, both read-only.  With VM they are also entered in T's
+ * supplemental page table, as special pages that have no frame.
+ * Called on exec, and on fork so that the child gets a private
+ * page of its own instead of a copy of its parent's.  Returns
+ * false if memory allocation fails. */
+bool
+vdata_map (struct thread *t) {
+	struct vdata_proc *p;
+
+	ASSERT (vdata != NULL);
+	p = palloc_get_page (PAL_USER | PAL_ZERO);
+	if (p == NULL)
+		return false;
+	p->version = VDATA_VERSION;
+	p->pid = t->tid;
+	if (!pml4_set_page (t->pml4, (void *) VDATA_PROC_ADDR, p, false)) {
+		palloc_free_page (p);
+		return false;
+	}
+	if (!pml4_set_page (t->pml4, (void *) VDATA_ADDR, vdata, false))
+		return false;
+#ifdef VM
+	if (!vm_register_special_page (&t->spt, (void *) VDATA_PROC_ADDR)
+			|| !vm_register_special_page (&t->spt, (void *) VDATA_ADDR))
+		return false;
+#endif
+	return true;
+}
+
+/* Unmaps the shared page from T's address space, which is about to
+ * be destroyed, so that it is not freed along with it.  The private
+ * page is. */
+void
+vdata_unmap (struct thread *t) {
+	if (pml4_get_page (t->pml4, (void *) VDATA_ADDR) == vdata)
+		pml4_clear_page (t->pml4, (void *) VDATA_ADDR);
+}
+
+/* Returns true if the SIZE bytes at user address UADDR overlap the
+ * kernel data pages, which are reserved in every address space. */
+bool
+vdata_overlaps (const void *uaddr, size_t size) {
+	uintptr_t start = (uintptr_t) uaddr;
+
+	return start < VDATA_END && start + size > VDATA_ADDR;
+}
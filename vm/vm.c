@@ -1,9 +1,18 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/vdata.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Every frame handed out by vm_get_frame(), in clock order. */
+static struct list frame_table;
+static struct lock frame_lock;          /* Protects frame_table, busy
+                                           and pinned. */
+static struct list_elem *clock_hand;    /* Next frame to examine. */
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -16,6 +25,9 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	lock_init (&frame_lock);
+	clock_hand = NULL;
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -48,6 +60,10 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
 
+	/* The kernel data pages are reserved. */
+	if (vdata_overlaps (upage, PGSIZE))
+		return false;
+
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
 		/* TODO: Create the page, fetch the initialier according to the VM type,
@@ -85,11 +101,77 @@ spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 	return true;
 }
 
+/* A special page never enters a frame. */
+static bool
+special_swap_in (struct page *page UNUSED, void *kva UNUSED) {
+	return false;
+}
+
+static bool
+special_swap_out (struct page *page UNUSED) {
+	return false;
+}
+
+static const struct page_operations special_ops = {
+	.swap_in = special_swap_in,
+	.swap_out = special_swap_out,
+	.destroy = NULL,
+	.type = VM_ANON | VM_SPECIAL,
+};
+
+/* Enters the page at user address VA, which the caller has mapped
+ * read-only itself, in SPT as a special page, so that the address
+ * is taken and faults on it are not handled.  The caller's mapping
+ * is left alone when the page is destroyed; pml4_destroy() frees
+ * the memory behind it, if it is the process's own.  Returns false
+ * if memory allocation fails. */
+bool
+vm_register_special_page (struct supplemental_page_table *spt, void *va) {
+	struct page *page = malloc (sizeof *page);
+
+	if (page == NULL)
+		return false;
+	page->operations = &special_ops;
+	page->va = pg_round_down (va);
+	page->frame = NULL;
+	page->accessed = false;
+	if (!spt_insert_page (spt, page)) {
+		free (page);
+		return false;
+	}
+	return true;
+}
+
 /* Get the struct frame, that will be evicted. */
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	size_t i, frame_cnt;
+
+	/* Second-chance clock over the frame table.  Two full sweeps
+	 * clear every reference bit, so a victim is found unless every
+	 * frame is busy. */
+	lock_acquire (&frame_lock);
+	frame_cnt = list_size (&frame_table);
+	for (i = 0; i < 2 * frame_cnt; i++) {
+		struct frame *frame;
+
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+
+		if (frame->busy || frame->pinned || frame->page == NULL)
+			continue;
+		if (frame->page->accessed) {
+			frame->page->accessed = false;
+			continue;
+		}
+		frame->busy = true;
+		victim = frame;
+		break;
+	}
+	lock_release (&frame_lock);
 
 	return victim;
 }
@@ -98,9 +180,23 @@ vm_get_victim (void) {
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-
+	struct frame *victim;
+
+	/* A page may refuse to leave, e.g. while it is pinned, so keep
+	 * asking the clock for candidates. */
+	while ((victim = vm_get_victim ()) != NULL) {
+		/* On success, swap_out() detaches the page from the frame and
+		 * may free it, so it must not be touched afterward. */
+		if (swap_out (victim->page)) {
+			victim->page = NULL;
+			victim->busy = false;
+			return victim;
+		}
+
+		lock_acquire (&frame_lock);
+		victim->busy = false;
+		lock_release (&frame_lock);
+	}
 	return NULL;
 }
 
@@ -111,13 +207,93 @@ vm_evict_frame (void) {
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva = palloc_get_page (PAL_USER);
+
+	if (kva != NULL) {
+		frame = malloc (sizeof *frame);
+		if (frame == NULL)
+			PANIC ("frame table entry allocation failed");
+		frame->kva = kva;
+		frame->page = NULL;
+		frame->busy = false;
+		frame->pinned = false;
+
+		lock_acquire (&frame_lock);
+		list_push_back (&frame_table, &frame->elem);
+		lock_release (&frame_lock);
+	} else
+		frame = vm_evict_frame ();
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
+/* Removes FRAME from the frame table and frees its memory, unless
+ * it is busy being evicted.  Returns true if FRAME was freed; on
+ * false, the evicting thread owns FRAME and will detach its page
+ * through swap_out(). */
+bool
+vm_try_free_frame (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	if (frame->busy) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+	lock_release (&frame_lock);
+
+	palloc_free_page (frame->kva);
+	free (frame);
+	return true;
+}
+
+/* Keeps the page at user address VA of the current process in a
+ * frame, claiming one for it first if it has none, until
+ * vm_unpin_page() is called.  The kernel may then use the frame's
+ * kernel address while the process runs.  Returns false if there
+ * is no page at VA or it cannot be brought in. */
+bool
+vm_pin_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+
+	if (page == NULL)
+		return false;
+	for (;;) {
+		struct frame *frame;
+
+		lock_acquire (&frame_lock);
+		frame = page->frame;
+		if (frame != NULL && !frame->busy) {
+			frame->pinned = true;
+			lock_release (&frame_lock);
+			return true;
+		}
+		lock_release (&frame_lock);
+
+		/* The page is out, or on its way out. */
+		if (frame == NULL) {
+			if (!vm_do_claim_page (page))
+				return false;
+		} else
+			thread_yield ();
+	}
+}
+
+/* Lets the page at user address VA of the current process, pinned
+ * by vm_pin_page(), be evicted again. */
+void
+vm_unpin_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+
+	ASSERT (page != NULL && page->frame != NULL);
+	lock_acquire (&frame_lock);
+	page->frame->pinned = false;
+	lock_release (&frame_lock);
+}
+
 /* Growing the stack. */
 static void
 vm_stack_growth (void *addr UNUSED) {
@@ -134,6 +310,10 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
 	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
 	struct page *page = NULL;
+
+	/* The kernel data pages are always present and read-only. */
+	if (vdata_overlaps (addr, 1))
+		return false;
 	/* TODO: Validate the fault */
 	/* TODO: Your code goes here */
 
@@ -176,7 +356,9 @@ void
 supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst.  Special pages
+ * are not copied: __do_fork() maps the child's own kernel data
+ * pages. */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		struct supplemental_page_table *src UNUSED) {